@@ -112,7 +112,8 @@ oil2d::Properties* getProps()
 	return props;
 }*/
 
-void getFracPoints(Point2d point1, Point2d point2, const double w, const double r_w, vector<Point>& pts)
+// Wellbore circle is inserted only for the MESHED well, PEACEMAN well is not resolved by the mesh
+void getFracPoints(Point2d point1, Point2d point2, const double w, const double r_w, vector<Point>& pts, const bool withWellbore = true)
 {
 	const size_t size = pts.size();
 	pts.clear();
@@ -147,7 +148,7 @@ void getFracPoints(Point2d point1, Point2d point2, const double w, const double
 			hz = 2.0 * r_w;
 			const double hphi = (pts[pts.size()-1][0] - pts[pts.size() - 2][0] > 0.0) ? M_PI / (double)(CIRC_NUM + 1) : -M_PI / (double)(CIRC_NUM + 1);
 			const double start_phi = (point2.x - point1.x < 0.0) ? alpha : M_PI + alpha;
-			for (int j = 1; j <= CIRC_NUM; j++)
+			for (int j = 1; withWellbore && j <= CIRC_NUM; j++)
 				pts.push_back({ well_pt.x + r_w * cos(start_phi + (double)j * hphi), well_pt.y + r_w * sin(start_phi + (double)j * hphi) });
 		}
 		else
@@ -185,7 +186,7 @@ void getFracPoints(Point2d point1, Point2d point2, const double w, const double
 			hz = 2.0 * r_w;
 			const double hphi = (pts[pts.size() - 2][0] - pts[pts.size() - 1][0] > 0.0) ? M_PI / (double)(CIRC_NUM + 1) : -M_PI / (double)(CIRC_NUM + 1);
 			const double start_phi = (point1.x - point2.x < 0.0) ? alpha : M_PI + alpha;
-			for (int j = 1; j <= CIRC_NUM; j++)
+			for (int j = 1; withWellbore && j <= CIRC_NUM; j++)
 				pts.push_back({ well_pt.x + r_w * cos(start_phi + (double)j * hphi), well_pt.y + r_w * sin(start_phi + (double)j * hphi) });
 		}
 		else
@@ -204,7 +205,7 @@ void getFracPoints(Point2d point1, Point2d point2, const double w, const double
 	}
 	//task->bodies[0].constraint.push_back(make_pair(p2, pt1));
 }
-Task* getMeshTask(double& x_dim, double r_w)
+Task* getMeshTask(double& x_dim, double r_w, const bool withSymmetry = false, const bool withGrading = false)
 {
 	Task* task = new Task;
 
@@ -215,6 +216,9 @@ Task* getMeshTask(double& x_dim, double r_w)
 	const double l = 50.0 / x_dim;
 
 	task->spatialStep = 50.0 / x_dim;
+	// Step grows from the fracture width at the well and fracture up to spatialStep
+	if (withGrading)
+		task->minStep = w;
 	Point2d pt1 = { l, l }, pt2 = { -l, -l };
 	Point2d pt_well = (pt1 + pt2) / 2.0;
 	Task::Body::Border body1border = { { a, a }, { -a, a }, { -a, -a }, { a, -a } };
@@ -222,10 +226,13 @@ Task* getMeshTask(double& x_dim, double r_w)
 
 	const size_t size = 101;
 	vector<Point> pts(size);
-	getFracPoints(pt1, pt2, w, r_w, pts);
+	getFracPoints(pt1, pt2, w, r_w, pts, task->bodies[0].wellModel == WELL_MODEL::MESHED);
 	for(size_t i = 1; i < pts.size(); i++)
 		task->bodies[0].constraint.push_back(make_pair(pts[i-1], pts[i]));
 	task->bodies[0].constraint.push_back(make_pair(pts[pts.size()-1], pts[0]));
+	// Diagonal fracture with the centered well is symmetric with respect to both diagonals
+	if (withSymmetry)
+		task->symmetryPlanes = { make_pair(Point{ 0.0, 0.0 }, Point{ 1.0, 1.0 }), make_pair(Point{ 0.0, 0.0 }, Point{ -1.0, 1.0 }) };
 
 	return task;
 }
@@ -234,14 +241,31 @@ double acid2d::Component::T = 300.0;
 
 int main(int argc, char* argv[])
 {
+	// "--benchmark" times the assembly instead of running the simulation,
+	// "--symmetry" meshes only the symmetric sector of the domain,
+	// "--graded" refines the mesh towards the well and fracture
+	bool isBenchmark = false, withSymmetry = false, withGrading = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "--benchmark")
+			isBenchmark = true;
+		else if (string(argv[i]) == "--symmetry")
+			withSymmetry = true;
+		else if (string(argv[i]) == "--graded")
+			withGrading = true;
+	}
+
 	const auto props = getProps();
-	const auto task = getMeshTask(props->R_dim, props->r_w);
+	const auto task = getMeshTask(props->R_dim, props->r_w, withSymmetry, withGrading);
 	
 	Scene<oil2d::Oil2d, oil2d::Oil2dSolver, oil2d::Properties> scene;
 	//Scene<acid2d::Acid2d, acid2d::Acid2dSolver, acid2d::Properties> scene;
 
 	scene.load(*props, *task);
-	scene.start();
+	if (isBenchmark)
+		scene.benchmark();
+	else
+		scene.start();
 
 	return 0;
 }
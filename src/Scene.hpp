@@ -34,6 +34,10 @@ public:
 	{
 		method->start();
 	}
+	void benchmark()
+	{
+		method->benchmarkAssembly();
+	}
 };
 
 #endif /* SCENE_HPP_ */
\ No newline at end of file
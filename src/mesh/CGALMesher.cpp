@@ -1,46 +1,252 @@
 #include <CGAL/Delaunay_mesh_face_base_2.h>
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
-#include <CGAL/Delaunay_mesh_size_criteria_2.h>
 #include <CGAL/Delaunay_mesher_2.h>
 
 #include <CGAL/lloyd_optimize_mesh_2.h>
+
 #include "src/mesh/CGALMesher.hpp"
 
 using namespace cgalmesher;
 
-IntermediateTriangulation Cgal2DMesher::triangulate(const double spatialStep, const std::vector<CgalBody> bodies,		
-									std::vector<size_t>& constrainedCells)
+namespace
 {
 	typedef CGAL::Delaunay_mesh_face_base_2<K>				     Fb;
 	typedef CGAL::Triangulation_data_structure_2<Vb, Fb>        Tds;
 	typedef CGAL::Constrained_Delaunay_triangulation_2<K, Tds>  CDT;
-	typedef CGAL::Delaunay_mesh_size_criteria_2<CDT>            Criteria;
+	typedef LocalSizeCriteria<CDT>                              Criteria;
 	typedef CGAL::Delaunay_mesher_2<CDT, Criteria>              Mesher;
 
-	CDT cdt;
+	/// Refined triangulation of the bodies borders kept between incremental runs
+	/// It is reused while the spatial step and the borders stay the same
+	struct FarField
+	{
+		CDT cdt;
+		std::vector<double> key;
+	} farField;
+
+	std::vector<double> getFarFieldKey(const double spatialStep, const std::vector<Cgal2DMesher::CgalBody>& bodies)
+	{
+		std::vector<double> key = { spatialStep };
+		auto addPolygon = [&key](const Polygon& polygon)
+		{
+			key.push_back(static_cast<double>(polygon.size()));
+			for (auto it = polygon.vertices_begin(); it != polygon.vertices_end(); ++it)
+			{
+				key.push_back(it->x());
+				key.push_back(it->y());
+			}
+		};
+		for (const auto& body : bodies)
+		{
+			addPolygon(body.outer);
+			for (const auto& cavity : body.inner)
+				addPolygon(cavity);
+		}
+		return key;
+	};
+	/// Removes far-field vertices closer than the margin to the constraints
+	/// so the neighbourhood of new constraints is refined from scratch
+	size_t clearNeighbourhood(CDT& cdt, const std::vector<Cgal2DMesher::CgalBody>& bodies, const double margin)
+	{
+		std::vector<std::pair<CgalPoint2, CgalPoint2>> segments;
+		for (const auto& body : bodies)
+			segments.insert(segments.end(), body.constraint.begin(), body.constraint.end());
+		if (segments.empty())
+			return 0;
+
+		/// segments are bucketed into the grid with the margin step, so the vertex
+		/// can be close only to the segments in its own or adjacent grid cells
+		double x_min = segments[0].first.x(), x_max = x_min;
+		double y_min = segments[0].first.y(), y_max = y_min;
+		for (const auto& seg : segments)
+			for (const auto& pt : { seg.first, seg.second })
+			{
+				x_min = std::min(x_min, pt.x());	x_max = std::max(x_max, pt.x());
+				y_min = std::min(y_min, pt.y());	y_max = std::max(y_max, pt.y());
+			}
+		const int nx = static_cast<int>((x_max - x_min) / margin) + 1;
+		const int ny = static_cast<int>((y_max - y_min) / margin) + 1;
+		auto getCol = [=](const double x) { return static_cast<int>(floor((x - x_min) / margin)); };
+		auto getRow = [=](const double y) { return static_cast<int>(floor((y - y_min) / margin)); };
+		std::vector<std::vector<int>> grid(nx * ny);
+		for (int i = 0; i < static_cast<int>(segments.size()); i++)
+		{
+			const auto& seg = segments[i];
+			const int col_beg = getCol(std::min(seg.first.x(), seg.second.x())), col_end = std::min(nx - 1, getCol(std::max(seg.first.x(), seg.second.x())));
+			const int row_beg = getRow(std::min(seg.first.y(), seg.second.y())), row_end = std::min(ny - 1, getRow(std::max(seg.first.y(), seg.second.y())));
+			for (int row = row_beg; row <= row_end; row++)
+				for (int col = col_beg; col <= col_end; col++)
+					grid[row * nx + col].push_back(i);
+		}
+
+		const double margin2 = margin * margin;
+		auto isClose = [&](const CgalPoint2& p)
+		{
+			const int col = getCol(p.x()), row = getRow(p.y());
+			for (int r = std::max(0, row - 1); r <= std::min(ny - 1, row + 1); r++)
+				for (int c = std::max(0, col - 1); c <= std::min(nx - 1, col + 1); c++)
+					for (const int idx : grid[r * nx + c])
+						if (CGAL::to_double(CGAL::squared_distance(p, K::Segment_2(segments[idx].first, segments[idx].second))) < margin2)
+							return true;
+			return false;
+		};
+
+		std::vector<CDT::Vertex_handle> removed;
+		for (auto v = cdt.finite_vertices_begin(); v != cdt.finite_vertices_end(); ++v)
+		{
+			const auto& p = v->point();
+			if (p.x() > x_min - margin && p.x() < x_max + margin &&
+				p.y() > y_min - margin && p.y() < y_max + margin &&
+				!cdt.are_there_incident_constraints(v) && isClose(p))
+				removed.push_back(v);
+		}
+		for (auto& v : removed)
+			cdt.remove(v);
+		return removed.size();
+	};
+};
+
+void GradedSizing::build()
+{
+	grid.clear();
+	if (segments.empty())
+		return;
+
+	x_min = x_max = segments[0].first.x();
+	y_min = y_max = segments[0].first.y();
+	double length = 0.0;
+	for (const auto& seg : segments)
+	{
+		for (const auto& pt : { seg.first, seg.second })
+		{
+			x_min = std::min(x_min, pt.x());	x_max = std::max(x_max, pt.x());
+			y_min = std::min(y_min, pt.y());	y_max = std::max(y_max, pt.y());
+		}
+		length += sqrt(CGAL::to_double(CGAL::squared_distance(seg.first, seg.second)));
+	}
+	/// about one segment per grid cell
+	const double area = std::max((x_max - x_min) * (y_max - y_min), std::numeric_limits<double>::min());
+	cellSize = std::max(length / segments.size(), sqrt(area / segments.size()));
+	nx = static_cast<int>((x_max - x_min) / cellSize) + 1;
+	ny = static_cast<int>((y_max - y_min) / cellSize) + 1;
+	grid.resize(nx * ny);
+	for (int i = 0; i < static_cast<int>(segments.size()); i++)
+	{
+		const auto& seg = segments[i];
+		const int col_beg = getCol(std::min(seg.first.x(), seg.second.x())), col_end = getCol(std::max(seg.first.x(), seg.second.x()));
+		const int row_beg = getRow(std::min(seg.first.y(), seg.second.y())), row_end = getRow(std::max(seg.first.y(), seg.second.y()));
+		for (int row = row_beg; row <= row_end; row++)
+			for (int col = col_beg; col <= col_end; col++)
+				grid[row * nx + col].push_back(i);
+	}
+}
+double GradedSizing::operator()(const CgalPoint2& p) const
+{
+	/// step does not grow from h_min, d_max below is not defined
+	if (growth <= 0.0)
+		return std::min(h_max, h_min);
+	/// step reaches h_max at this distance, farther segments do not matter
+	const double d_max = (h_max - h_min) / growth;
+	double dist2 = d_max * d_max;
+	for (const auto& well : wells)
+		dist2 = std::min(dist2, CGAL::to_double(CGAL::squared_distance(p, well)));
+
+	const double dx = std::max(0.0, std::max(x_min - p.x(), p.x() - x_max));
+	const double dy = std::max(0.0, std::max(y_min - p.y(), p.y() - y_max));
+	if (!grid.empty() && dx * dx + dy * dy < dist2)
+	{
+		const int col = getCol(p.x()), row = getRow(p.y());
+		const int ringsNum = std::max(std::max(col, nx - 1 - col), std::max(row, ny - 1 - row));
+		for (int k = 0; k <= ringsNum; k++)
+		{
+			/// segments beyond the ring k - 1 are not closer than (k - 1) * cellSize
+			const double bound = (k - 1) * cellSize;
+			if (k > 0 && bound * bound >= dist2)
+				break;
+			for (int r = row - k; r <= row + k; r++)
+			{
+				if (r < 0 || r >= ny)
+					continue;
+				/// inner rows of the ring have only two cells
+				const int step = (r == row - k || r == row + k) ? 1 : std::max(2 * k, 1);
+				for (int c = col - k; c <= col + k; c += step)
+				{
+					if (c < 0 || c >= nx)
+						continue;
+					for (const int idx : grid[r * nx + c])
+					{
+						const auto& seg = segments[idx];
+						dist2 = std::min(dist2, CGAL::to_double(CGAL::squared_distance(p, K::Segment_2(seg.first, seg.second))));
+					}
+				}
+			}
+		}
+	}
+	return std::min(h_max, h_min + growth * sqrt(dist2));
+}
+
+IntermediateTriangulation Cgal2DMesher::triangulate(const double spatialStep, const std::vector<CgalBody> bodies,		
+									std::vector<size_t>& constrainedCells, const SizingFunction& sizing,
+									const bool incremental)
+{
+	const SizingFunction uniform = [spatialStep](const CgalPoint2&) { return spatialStep; };
 	// Special "seeds" in the interior of inner cavities
 	// to tell CGAL do not mesh these cavities
 	std::list<CgalPoint2> listOfSeeds;
 
 	// insert all bodies to triangulation as its constraints
-	for (const auto& body : bodies) 
+	auto insertBorders = [&bodies](CDT& tr)
+	{
+		for (const auto& body : bodies)
+		{
+			insertPolygon(body.outer, tr);
+			for (const auto& innerCavity : body.inner)
+			{
+				insertPolygon(innerCavity, tr);
+				//listOfSeeds.push_back(findInnerPoint(innerCavity));
+			}
+			//listOfSeeds.push_back(CDT::Point(1.0, 1.0));
+		}
+	};
+
+	CDT cdt;
+	if (incremental)
 	{
-		insertPolygon(body.outer, cdt);
-		for (const auto& innerCavity : body.inner) 
+		/// far field is meshed by the uniform step once, every next run
+		/// copies it and remeshes only the neighbourhood of the constraints
+		const auto key = getFarFieldKey(spatialStep, bodies);
+		if (farField.key != key)
 		{
-			insertPolygon(innerCavity, cdt);
-			//listOfSeeds.push_back(findInnerPoint(innerCavity));
+			farField.cdt.clear();
+			insertBorders(farField.cdt);
+			Mesher farMesher(farField.cdt);
+			farMesher.set_criteria(Criteria(0.1, uniform));
+			farMesher.refine_mesh();
+			farField.key = key;
 		}
-		//listOfSeeds.push_back(CDT::Point(1.0, 1.0));
+		cdt = farField.cdt;
+		clearNeighbourhood(cdt, bodies, 2.0 * spatialStep);
+	}
+	else
+		insertBorders(cdt);
+
+	for (const auto& body : bodies)
 		for (const auto& con : body.constraint)
 			cdt.insert_constraint(con.first, con.second);
-	}
 
 	Mesher mesher(cdt);
-	mesher.set_criteria(Criteria(0.1, spatialStep));
+	mesher.set_criteria(Criteria(0.1, sizing ? sizing : uniform));
 	mesher.refine_mesh();
 	//CGAL::lloyd_optimize_mesh_2(cdt, CGAL::parameters::max_iteration_number = 10);
 
+	/// cells with all vertices inside or on the border of any fracture polygon
+	auto isInFrac = [&bodies](const CgalPoint2& pt)
+	{
+		for (const auto& body : bodies)
+			if (body.frac.locate({ pt[0], pt[1] }) != mesh::PolygonIndex::LOCATION::OUTSIDE)
+				return true;
+		return false;
+	};
 	size_t cell_idx = 0;
 	int vert_bounded;
 	for (auto cellIter = cdt.finite_faces_begin(); cellIter != cdt.finite_faces_end(); ++cellIter)
@@ -48,8 +254,7 @@ IntermediateTriangulation Cgal2DMesher::triangulate(const double spatialStep, co
 		vert_bounded = 0;
 		for (int i = 0; i < 3; i++)
 		{
-			const auto& pt = cellIter->vertex(i)->point();
-			if (bodies[0].frac.has_on_unbounded_side(pt))
+			if (!isInFrac(cellIter->vertex(i)->point()))
 				break;
 
 			vert_bounded++;
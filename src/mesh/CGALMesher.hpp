@@ -4,6 +4,9 @@
 #include <string>
 #include <fstream>
 #include <utility>
+#include <functional>
+#include <algorithm>
+#include <limits>
 
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Exact_predicates_exact_constructions_kernel.h>
@@ -11,8 +14,10 @@
 #include <CGAL/Triangulation_face_base_with_info_2.h>
 #include <CGAL/Delaunay_triangulation_2.h>
 #include <CGAL/Polygon_2.h>
+#include <CGAL/Delaunay_mesh_size_criteria_2.h>
 
 #include "src/models/Element.hpp"
+#include "src/mesh/PolygonIndex.hpp"
 
 namespace cgalmesher
 {
@@ -26,6 +31,102 @@ namespace cgalmesher
 	typedef IntermediateTriangulation::Point						CgalPoint2;
 	typedef IntermediateTriangulation::Geom_traits::Vector_2		CgalVector2;
 	typedef CGAL::Polygon_2<K, std::vector<CgalPoint2>>				Polygon;
+
+	/// Local spatial step at the given point
+	typedef std::function<double(const CgalPoint2&)>				SizingFunction;
+
+	/**
+	* Delaunay_mesh_size_criteria_2 with the size bound varying over the domain
+	* The bound is taken at the centroid of the face, shape criteria stays the same
+	*/
+	template<typename CDT>
+	class LocalSizeCriteria : public CGAL::Delaunay_mesh_size_criteria_2<CDT>
+	{
+	protected:
+		typedef CGAL::Delaunay_mesh_size_criteria_2<CDT> Base;
+		typedef typename CDT::Geom_traits Geom_traits;
+		SizingFunction sizing;
+	public:
+		typedef typename Base::Quality Quality;
+
+		LocalSizeCriteria(const double aspect_bound, const SizingFunction& _sizing, const Geom_traits& traits = Geom_traits())
+			: Base(aspect_bound, 0.0, traits), sizing(_sizing) {};
+
+		class Is_bad : public Base::Is_bad
+		{
+		protected:
+			const SizingFunction& sizing;
+		public:
+			typedef typename Base::Is_bad::Point_2 Point_2;
+
+			Is_bad(const double aspect_bound, const SizingFunction& _sizing, const Geom_traits& traits)
+				: Base::Is_bad(aspect_bound, 0.0, traits), sizing(_sizing) {};
+
+			using Base::Is_bad::operator();
+			CGAL::Mesh_2::Face_badness operator()(const typename CDT::Face_handle& fh, Quality& q) const
+			{
+				const Point_2& pa = fh->vertex(0)->point();
+				const Point_2& pb = fh->vertex(1)->point();
+				const Point_2& pc = fh->vertex(2)->point();
+
+				const double a = CGAL::to_double(CGAL::squared_distance(pb, pc));
+				const double b = CGAL::to_double(CGAL::squared_distance(pc, pa));
+				const double c = CGAL::to_double(CGAL::squared_distance(pa, pb));
+				const double max_sq_length = std::max(a, std::max(b, c));
+				const double second_max_sq_length = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+				/// edge length normalized by the local size bound
+				const double h = sizing(CGAL::centroid(pa, pb, pc));
+				q.second = max_sq_length / h / h;
+				if (q.size() > 1.0)
+				{
+					q.first = 1.0;
+					return CGAL::Mesh_2::IMPERATIVELY_BAD;
+				}
+
+				const double area = 2.0 * CGAL::to_double(CGAL::area(pa, pb, pc));
+				q.first = area * area / (max_sq_length * second_max_sq_length);
+				if (q.sine() < this->B)
+					return CGAL::Mesh_2::BAD;
+				else
+					return CGAL::Mesh_2::NOT_BAD;
+			};
+		};
+
+		Is_bad is_bad_object() const
+		{
+			return Is_bad(this->bound(), sizing, this->traits);
+		};
+	};
+
+	/**
+	* Step growing linearly with the distance to the well and fracture segments,
+	* h = min(h_max, h_min + growth * d), that is logarithmic spacing of the cells
+	* around the well as in radial grids
+	* Segments are bucketed into a uniform grid, the nearest one is searched by rings of grid cells
+	*/
+	struct GradedSizing
+	{
+		double h_min, h_max, growth;
+		std::vector<CgalPoint2> wells;
+		std::vector<std::pair<CgalPoint2, CgalPoint2>> segments;
+
+		/// bucket segments into the grid, has to be called after all segments are added
+		void build();
+		double operator()(const CgalPoint2& p) const;
+	protected:
+		double x_min = 0.0, y_min = 0.0, x_max = 0.0, y_max = 0.0, cellSize = 1.0;
+		int nx = 0, ny = 0;
+		std::vector<std::vector<int>> grid;
+		inline int getCol(const double x) const
+		{
+			return std::max(0, std::min(nx - 1, static_cast<int>((x - x_min) / cellSize)));
+		};
+		inline int getRow(const double y) const
+		{
+			return std::max(0, std::min(ny - 1, static_cast<int>((y - y_min) / cellSize)));
+		};
+	};
 	
 	/**
 	* 2D mesher by CGAL library
@@ -45,6 +146,7 @@ namespace cgalmesher
 			Border outer;              ///< outer border of the body
 			std::vector<Border> inner; ///< borders of the inner cavities of the body
 			std::vector<Edge> constraint;
+			std::vector<Edge> fractures; ///< 1D fractures, meshed as constraints only
 		};
 		/// Body structure used inside the mesher
 		struct CgalBody 
@@ -56,8 +158,7 @@ namespace cgalmesher
 			Polygon outer;              ///< outer border of the body
 			std::vector<Polygon> inner; ///< borders of the inner cavities of the body
 			std::vector<std::pair<Point,Point>> constraint;
-			Polygon frac;
-			
+			mesh::PolygonIndex frac;    ///< fracture polygons closed by constraints
 
 			CgalBody(const TaskBody& task) : id(task.id), outer(makePolygon(task.outer)), r_w(task.r_w), well(task.well[0], task.well[1])
 			{
@@ -67,8 +168,12 @@ namespace cgalmesher
 				{
 					constraint.push_back(std::make_pair<Point, Point>({ con.first[0], con.first[1] },
 					{ con.second[0], con.second[1] }));
-					frac.push_back(CgalPoint2(con.first[0], con.first[1]));
 				}
+				for (const auto& con : task.fractures)
+					constraint.push_back(std::make_pair<Point, Point>({ con.first[0], con.first[1] },
+					{ con.second[0], con.second[1] }));
+				frac.addConstraints(task.constraint);
+				frac.build();
 			};
 			bool contains(const CgalPoint2& p) const
 			{
@@ -140,6 +245,9 @@ namespace cgalmesher
 		* @param spatialStep         effective spatial step
 		* @param bodies              list of bodies to construct
 		* @param result              triangulation to write the result in
+		* @param sizing              local spatial step, spatialStep everywhere if empty
+		* @param incremental         keep the far field meshed by the previous call with the same borders
+		*                            and remesh only the neighbourhood of the constraints
 		* @tparam ResultingTriangulation type of the triangulation to write result in
 		* @tparam CellConverter          see DefaultCellConverter
 		* @tparam VertexConverter        see DefaultVertexConverter
@@ -148,16 +256,18 @@ namespace cgalmesher
 				template<typename, typename> class CellConverter = DefaultCellConverter,
 				template<typename, typename> class VertexConverter = DefaultVertexConverter>
 		static void triangulate(const double spatialStep, const std::vector<TaskBody> bodies, ResultingTriangulation& result,
-								std::vector<size_t>& constrainedCells)
+								std::vector<size_t>& constrainedCells, const SizingFunction& sizing = SizingFunction(),
+								const bool incremental = false)
 		{
 			copyTriangulation<IntermediateTriangulation, ResultingTriangulation,
-				CellConverter, VertexConverter>(triangulate(spatialStep, convert(bodies), constrainedCells), result);
+				CellConverter, VertexConverter>(triangulate(spatialStep, convert(bodies), constrainedCells, sizing, incremental), result);
 		}
 
 	private:
-		/** The meshing itself */
+		/** The meshing itself, the far field of incremental runs is not thread-safe */
 		static IntermediateTriangulation triangulate(
-			const double spatialStep, const std::vector<CgalBody> bodies, std::vector<size_t>& constrainedCells);
+			const double spatialStep, const std::vector<CgalBody> bodies, std::vector<size_t>& constrainedCells,
+			const SizingFunction& sizing, const bool incremental);
 
 
 		/**
@@ -0,0 +1,111 @@
+#ifndef MESHDATA_HPP_
+#define MESHDATA_HPP_
+
+#include <array>
+#include <vector>
+#include <utility>
+
+#include "src/models/Cell.hpp"
+#include "src/models/Element.hpp"
+
+// Numbering of cells and vertices applied after meshing
+enum class ORDERING { NATIVE, RCM, HILBERT };
+// MESHED well merges fracture cells inside the wellbore into one cell,
+// PEACEMAN well is connected to the cells containing the well point by the well index
+enum class WELL_MODEL { MESHED, PEACEMAN };
+
+struct Task
+{
+	double spatialStep;
+	// Graded meshing: step grows from minStep at the well and fracture up to spatialStep
+	// Zero minStep or stepGrowth means uniform step over the domain
+	double minStep = 0.0;
+	double stepGrowth = 0.3;
+	ORDERING ordering = ORDERING::RCM;
+	// If true the processed mesh is stored on disk and reused for the same task
+	bool cacheMesh = true;
+	// If true the meshed far field is kept between builds with the same borders and step,
+	// only the neighbourhood of the constraints and fractures is remeshed (sweeps over fracture geometry)
+	bool incrementalMeshing = false;
+	struct Body {
+		typedef std::array<double, 2> Point;
+		typedef std::vector<Point> Border;
+		typedef std::pair<Point, Point> Edge;
+
+		size_t id;                  ///< body indicator > 0 @see Task::Body
+		double r_w;
+		Point well;
+		Border outer;               ///< outer border of the body
+		std::vector<Border> inner;  ///< borders of the inner cavities
+		std::vector<Edge> constraint;
+		WELL_MODEL wellModel = WELL_MODEL::MESHED;
+		// 1D fractures inserted as plain constraints, their edges become CONSTRAINED cells
+		std::vector<Edge> fractures;
+		double fracWidth = 0.0;
+	};
+	std::vector<Body> bodies;
+	// Symmetry lines given by two points, only the sector on the left of each directed line is meshed
+	std::vector<Body::Edge> symmetryPlanes;
+};
+
+namespace mesh
+{
+	// Runtime mesh in flat index-based arrays, it does not depend on the mesher
+	// Inner cells go first, border cells next, then 1D fracture cells and the well cell is the last one
+	class MeshData
+	{
+	public:
+		static const int CELL_POINTS_NUMBER = 3;
+
+		size_t inner_cells = 0, inner_beg = 0;
+		size_t border_edges = 0, border_beg = 0;
+		// Border cells on the symmetry lines close the border range, they get no-flow conditions
+		size_t symmetry_edges = 0;
+		size_t constrained_edges = 0, constrained_beg = 0;
+		// Aperture of 1D fracture cells
+		double fracWidth = 0.0;
+		size_t well_idx = 0;
+		WELL_MODEL wellModel = WELL_MODEL::MESHED;
+		std::vector<TriangleCell> cells;
+		std::vector<point::Point2d> vertices;
+		// Indices of fracture cells and cells merged into the well
+		std::vector<size_t> fracCells;
+		std::vector<size_t> wellCells;
+		// For the PEACEMAN well these are perforated cells, length is the angle of the cell around
+		// the well and dist is ln(r_o / r_w), so the face transmissibility gives the well index
+		// For 1D fracture cells of the PEACEMAN well length is the aperture and dist is the distance to the well
+		struct WellNebr
+		{
+			size_t id;
+			double length;
+			double dist;
+		};
+		std::vector<WellNebr> wellNebrs;
+		// Index of the cell in wellNebrs if it is connected to the PEACEMAN well, -1 otherwise
+		// Table is filled by setPerfIdx once the numbering of cells is final
+		std::vector<int> perfIdx;
+		void setPerfIdx()
+		{
+			perfIdx.assign(cells.size(), -1);
+			if (wellModel == WELL_MODEL::PEACEMAN)
+				for (size_t k = 0; k < wellNebrs.size(); k++)
+					perfIdx[wellNebrs[k].id] = static_cast<int>(k);
+		};
+		inline int getPerfIdx(const size_t cell_id) const
+		{
+			return perfIdx[cell_id];
+		};
+		double well_vol = 0.0;
+		double Volume = 0.0;
+		// Ratio of the full domain to the simulated sector and the symmetry lines of the sector
+		double symmetryFactor = 1.0;
+		std::vector<Task::Body::Edge> symmetryPlanes;
+
+		inline bool isSymmetry(const size_t cell_id) const
+		{
+			return cell_id < border_beg + border_edges && cell_id >= border_beg + border_edges - symmetry_edges;
+		};
+	};
+};
+
+#endif /* MESHDATA_HPP_ */
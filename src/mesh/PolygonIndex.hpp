@@ -0,0 +1,142 @@
+#ifndef POLYGONINDEX_HPP_
+#define POLYGONINDEX_HPP_
+
+#include <array>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+
+namespace mesh
+{
+	/**
+	* Point location against a set of simple polygons
+	* Edges are bucketed into horizontal strips, so the ray casting
+	* visits only the edges crossing the strip of the point
+	*/
+	class PolygonIndex
+	{
+	public:
+		enum class LOCATION { OUTSIDE, INSIDE, BOUNDARY };
+		typedef std::array<double, 2> Point;
+		typedef std::pair<Point, Point> Edge;
+	protected:
+		struct IndexedEdge
+		{
+			Point a, b;
+			int polygon;
+		};
+		std::vector<IndexedEdge> edges;
+		int polygonsNum = 0;
+
+		double y_min = 0.0, y_max = 0.0, strip_h = 1.0, tol = 0.0;
+		std::vector<std::vector<int>> strips;
+		inline int getStrip(const double y) const
+		{
+			return std::min(static_cast<int>((y - y_min) / strip_h), static_cast<int>(strips.size()) - 1);
+		};
+		static inline double distance2(const Point& p, const IndexedEdge& e)
+		{
+			const double dx = e.b[0] - e.a[0], dy = e.b[1] - e.a[1];
+			const double len2 = dx * dx + dy * dy;
+			double t = (len2 > 0.0) ? ((p[0] - e.a[0]) * dx + (p[1] - e.a[1]) * dy) / len2 : 0.0;
+			t = std::max(0.0, std::min(1.0, t));
+			const double x = e.a[0] + t * dx - p[0], y = e.a[1] + t * dy - p[1];
+			return x * x + y * y;
+		};
+	public:
+		/// add the closed polygon given by its vertices
+		void addPolygon(const std::vector<Point>& pts)
+		{
+			for (size_t i = 0; i < pts.size(); i++)
+				edges.push_back({ pts[i], pts[(i + 1) % pts.size()], polygonsNum });
+			polygonsNum++;
+		};
+		/// split the chain of constraint edges into closed polygons, a polygon ends when the chain returns to its start
+		void addConstraints(const std::vector<Edge>& constraint)
+		{
+			std::vector<Point> pts;
+			for (const auto& con : constraint)
+			{
+				pts.push_back(con.first);
+				if (con.second == pts[0])
+				{
+					addPolygon(pts);
+					pts.clear();
+				}
+			}
+			if (pts.size() > 2)
+				addPolygon(pts);
+		};
+		/// bucket edges into strips, has to be called after all polygons are added
+		/// edges are bucketed in the order of addition, so each strip lists them grouped by polygons
+		void build()
+		{
+			strips.clear();
+			if (edges.empty())
+				return;
+
+			double x_min = edges[0].a[0], x_max = x_min;
+			y_min = y_max = edges[0].a[1];
+			for (const auto& e : edges)
+			{
+				x_min = std::min(x_min, e.a[0]);	x_max = std::max(x_max, e.a[0]);
+				y_min = std::min(y_min, e.a[1]);	y_max = std::max(y_max, e.a[1]);
+			}
+			tol = 1.E-10 * std::max(x_max - x_min, y_max - y_min);
+			y_min -= tol;
+			y_max += tol;
+
+			strips.resize(edges.size());
+			strip_h = (y_max - y_min) / strips.size();
+			for (int i = 0; i < static_cast<int>(edges.size()); i++)
+			{
+				const auto& e = edges[i];
+				const int beg = getStrip(std::min(e.a[1], e.b[1]) - tol);
+				const int end = getStrip(std::max(e.a[1], e.b[1]) + tol);
+				for (int s = std::max(beg, 0); s <= end; s++)
+					strips[s].push_back(i);
+			}
+		};
+		/// location of the point and the index of the polygon containing it
+		LOCATION locate(const Point& p, int* polygon = nullptr) const
+		{
+			if (polygon)
+				*polygon = -1;
+			if (strips.empty() || p[1] < y_min || p[1] > y_max)
+				return LOCATION::OUTSIDE;
+
+			const auto& strip = strips[getStrip(p[1])];
+			for (const int idx : strip)
+				if (distance2(p, edges[idx]) <= tol * tol)
+				{
+					if (polygon)
+						*polygon = edges[idx].polygon;
+					return LOCATION::BOUNDARY;
+				}
+			// Edges of a strip are ordered by polygons, so the parity is tracked over the run of each polygon
+			bool isInside = false;
+			for (size_t k = 0; k < strip.size(); k++)
+			{
+				const auto& e = edges[strip[k]];
+				if ((e.a[1] > p[1]) != (e.b[1] > p[1]) &&
+					p[0] < e.a[0] + (p[1] - e.a[1]) * (e.b[0] - e.a[0]) / (e.b[1] - e.a[1]))
+					isInside = !isInside;
+				if (k + 1 == strip.size() || edges[strip[k + 1]].polygon != e.polygon)
+				{
+					if (isInside)
+					{
+						if (polygon)
+							*polygon = e.polygon;
+						return LOCATION::INSIDE;
+					}
+					isInside = false;
+				}
+			}
+			return LOCATION::OUTSIDE;
+		};
+		int getPolygonsNum() const { return polygonsNum; };
+	};
+};
+
+#endif /* POLYGONINDEX_HPP_ */
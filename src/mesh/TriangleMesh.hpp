@@ -4,41 +4,23 @@
 #include <array>
 #include <valarray>
 #include <set>
+#include <queue>
+#include <algorithm>
+#include <iostream>
 #include <utility>
-#include <CGAL/Triangle_2.h>
-#include <CGAL/Polygon_2.h>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
 
+#include "src/util/utils.h"
 #include "src/models/Variables.hpp"
 #include "src/models/Cell.hpp"
 #include "src/models/Element.hpp"
-#include "src/mesh/CGALMesher.hpp"
+#include "src/mesh/MeshData.hpp"
+#include "src/mesh/TriangleMeshBuilder.h"
 #include "src/snapshotter/VTKSnapshotter.hpp"
 
-class FirstModel;
-
-struct Task
-{
-	double spatialStep;
-	struct Body {
-		typedef std::array<double, 2> Point;
-		typedef std::vector<Point> Border;
-		typedef std::pair<Point, Point> Edge;
-
-		size_t id;                  ///< body indicator > 0 @see Task::Body
-		double r_w;
-		Point well;
-		Border outer;               ///< outer border of the body
-		std::vector<Border> inner;  ///< borders of the inner cavities
-		std::vector<Edge> constraint;
-	};
-	std::vector<Body> bodies;
-};
-struct CellInfo
-{
-	size_t id;
-};
-typedef size_t VertexInfo;
-
 namespace mesh
 {
 	static const int stencil = 4;
@@ -68,250 +50,561 @@ namespace mesh
 	};
 
 	template <typename TVariable>
-	class TriangleMesh
+	class TriangleMesh : public MeshData
 	{
 		template<typename> friend class VTKSnapshotter;
 		template<typename> friend class AbstractSolver;
 	public: 
-		typedef CGAL::Exact_predicates_inexact_constructions_kernel        K;
-		typedef CGAL::Triangulation_vertex_base_with_info_2<VertexInfo, K> Vb;
-		typedef CGAL::Triangulation_face_base_with_info_2<CellInfo, K>     Cb;
-		typedef CGAL::Triangulation_data_structure_2<Vb, Cb>               Tds;
-		typedef CGAL::Delaunay_triangulation_2<K, Tds>                     Triangulation;
-
-		typedef Triangulation::Vertex_handle           VertexHandle;
-		typedef Triangulation::Face_handle             CellHandle;
-		typedef Triangulation::Geom_traits::Vector_2   CgalVectorD;
-		typedef Triangulation::Point                   CgalPointD;
-		typedef Triangulation::All_faces_iterator      AllCellsIterator;
-		typedef Triangulation::Line_face_circulator    LineFaceCirculator;
 		typedef Iterator::Index LocalVertexIndex;
-		typedef std::vector<CellHandle>::const_iterator CellIterator;
-
 		typedef TriangleCell Cell;
-
-		static const int CELL_POINTS_NUMBER = 3;	
 	protected:
 		const double height;
 	public:
-		Triangulation triangulation;
-		size_t inner_cells = 0, inner_beg;
-		size_t border_edges = 0, border_beg;
-		size_t constrained_edges = 0, constrained_beg;
-		size_t well_idx;
-		std::vector<TriangleCell> cells;
-		std::vector<VertexHandle> vertexHandles;
-		std::vector<TriangleCell*> fracCells;
-		std::vector<TriangleCell*> wellCells;
-		struct WellNebr
+		// Face between two cells with the data used in fluxes
+		enum class FaceType { INNER, BORDER, WELL, FRAC };
+		struct Face
 		{
-			size_t id;
+			size_t cell1, cell2;
+			// Distances from the centers of the owners to the face center
+			double dist1, dist2;
 			double length;
-			double dist;
-		};
-		std::vector<WellNebr> wellNebrs;
-		double well_vol;
-		double Volume;
+			FaceType type;
 
-		double getDistance(const Cell& cell, const Cell& beta)
-		{
-			if (cell.type == CellType::WELL)
+			double getDistance(const size_t id) const
 			{
-				for (const auto& nebr : wellNebrs)
-					if (nebr.id == beta.id)
-						return nebr.dist;
-			}
+				return (id == cell1) ? dist1 : dist2;
+			};
+		};
+		std::vector<Face> faces;
+		// Indices of faces for each local face of inner cells and for each well neighbour
+		std::vector<size_t> cellFaces, wellFaces;
+		// Faces of 1D fracture cells in CSR format, matrix faces go first, then well faces and fracture junctions
+		std::vector<size_t> constrainedPtr, constrainedFaces;
+		inline size_t getFaceIdx(const Cell& cell, const size_t idx) const
+		{
+			if (cell.id == well_idx)
+				return wellFaces[idx];
+			else if (cell.type == CellType::CONSTRAINED)
+				return constrainedFaces[constrainedPtr[cell.id - constrained_beg] + idx];
+			else if (idx == CELL_POINTS_NUMBER)
+				return wellFaces[getPerfIdx(cell.id)];
 			else
-				return beta.getDistance(cell.id);
-		}
-
-		void load(const Task& task)
+				return cellFaces[CELL_POINTS_NUMBER * cell.id + idx];
+		};
+		// Perforated cells of the PEACEMAN well have the well as the extra last neighbour
+		// 1D fracture cells have two matrix neighbours and the fracture cells sharing their ends
+		inline int getNebrsNum(const Cell& cell) const
 		{
-			// Task reading
-			typedef cgalmesher::Cgal2DMesher::TaskBody Body;
-			std::vector<Body> bodies;
-			for (const auto& b : task.bodies)
-				bodies.push_back({ b.id, b.r_w, b.well, b.outer, b.inner, b.constraint });
-
-			// Triangulation sends addtional info about constraints
-			std::vector<size_t> constrainedCells;
-			cgalmesher::Cgal2DMesher::triangulate(task.spatialStep, bodies, triangulation, constrainedCells);
-
-			// Cells / Vertices addition
-			std::set<VertexHandle> localVertices;
-			size_t cell_idx = 0;
-			inner_beg = 0;
-			for (auto cellIter = triangulation.finite_faces_begin(); cellIter != triangulation.finite_faces_end(); ++cellIter)
+			if (cell.type == CellType::CONSTRAINED)
+				return static_cast<int>(constrainedPtr[cell.id - constrained_beg + 1] - constrainedPtr[cell.id - constrained_beg]);
+			return (getPerfIdx(cell.id) >= 0) ? CELL_POINTS_NUMBER + 1 : CELL_POINTS_NUMBER;
+		};
+		inline size_t getNebr(const Cell& cell, const int idx) const
+		{
+			if (cell.type == CellType::CONSTRAINED)
 			{
-				cellIter->info().id = cell_idx;
-				cells.push_back(TriangleCell(cell_idx++));
-				for (int i = 0; i < CELL_POINTS_NUMBER; i++)
-					localVertices.insert(cellIter->vertex(i));
-
-				auto& cell = cells[cells.size() - 1];
-				cell.type = CellType::INNER;
-				const auto& tri = triangulation.triangle(cellIter);
-				cell.V = fabs(tri.area() * height);
-				Volume += cell.V;
-				const auto center = CGAL::barycenter(tri.vertex(0), 1.0 / 3.0, tri.vertex(1), 1.0 / 3.0, tri.vertex(2));
-				cell.c = { center[0], center[1] };
+				const auto& face = getFace(cell, idx);
+				return (face.cell1 == cell.id) ? face.cell2 : face.cell1;
 			}
-			inner_cells = cells.size();
-
-			// Coping vertices from set to vector
-			vertexHandles.assign(localVertices.begin(), localVertices.end());
-			for (size_t i = 0; i < vertexHandles.size(); i++)
-				vertexHandles[i]->info() = i;
-
-			// Border / Constrained cells treatment
-			int nebrCounter;
-			size_t vecCounter = 0;
-			auto cellIter = triangulation.finite_faces_begin();
-			cells.reserve(int(1.5  * inner_cells));
-			border_beg = cells.size();
-			for (int cell_idx = 0; cell_idx < inner_cells; cell_idx++)
-			{
-				TriangleCell& cell = cells[cell_idx];
-				nebrCounter = 0;
+			return (idx < CELL_POINTS_NUMBER) ? cell.nebr[idx] : well_idx;
+		};
+		inline const Face& getFace(const Cell& cell, const size_t idx) const
+		{
+			return faces[getFaceIdx(cell, idx)];
+		};
 
+		// Table of unique faces, shared faces of inner cells are stored once
+		void buildFaces()
+		{
+			setPerfIdx();
+			faces.clear();
+			cellFaces.assign(CELL_POINTS_NUMBER * inner_cells, 0);
+			for (size_t cell_idx = 0; cell_idx < inner_cells; cell_idx++)
+			{
+				const auto& cell = cells[cell_idx];
 				for (int i = 0; i < CELL_POINTS_NUMBER; i++)
 				{
-					cell.points[i] = cellIter->vertex(i)->info();
-					const auto& nebr = cellIter->neighbor(i);
-
-					cell.length[i] = sqrt(fabs(CGAL::squared_distance(cellIter->vertex(cellIter->cw(i))->point(), cellIter->vertex(cellIter->ccw(i))->point())));
-					const point::Point2d& pt1 = { cellIter->vertex(cellIter->cw(i))->point()[0], cellIter->vertex(cellIter->cw(i))->point()[1] };
-					const point::Point2d& pt2 = { cellIter->vertex(cellIter->ccw(i))->point()[0], cellIter->vertex(cellIter->ccw(i))->point()[1] };
-					cell.dist[i] = point::distance(cell.c, (pt1 + pt2) / 2.0);
-					if (!triangulation.is_infinite(nebr))
+					const size_t nebr_idx = cell.nebr[i];
+					const auto& beta = cells[nebr_idx];
+					FaceType type;
+					if (nebr_idx < inner_cells)
 					{
-						cell.nebr[i] = nebr->info().id;
-						nebrCounter++;
+						int back = -1;
+						for (int j = 0; j < CELL_POINTS_NUMBER; j++)
+							if (beta.nebr[j] == cell_idx)
+								back = j;
+						if (back >= 0 && nebr_idx < cell_idx)
+						{
+							cellFaces[CELL_POINTS_NUMBER * cell_idx + i] = cellFaces[CELL_POINTS_NUMBER * nebr_idx + back];
+							continue;
+						}
+						type = FaceType::INNER;
 					}
+					else if (nebr_idx == well_idx)
+						type = FaceType::WELL;
+					else if (beta.type == CellType::CONSTRAINED)
+						type = FaceType::FRAC;
 					else
-					{
-						const point::Point2d& p1 = { cellIter->vertex(cellIter->cw(i))->point()[0], cellIter->vertex(cellIter->cw(i))->point()[1] };
-						const point::Point2d& p2 = { cellIter->vertex(cellIter->ccw(i))->point()[0], cellIter->vertex(cellIter->ccw(i))->point()[1] };
-						cells.push_back(TriangleCell(inner_cells + border_edges));
-						TriangleCell& edge = cells[cells.size() - 1];
-						edge.type = CellType::BORDER;
-						edge.c = (p1 + p2) / 2.0;
-						edge.V = point::distance(p1, p2);
-						edge.nebr[0] = cell_idx;
-						edge.points[0] = cellIter->vertex(cellIter->cw(i))->info();
-						edge.points[1] = cellIter->vertex(cellIter->ccw(i))->info();
-						cell.nebr[i] = inner_cells + border_edges;
-						border_edges++;
-					}
+						type = FaceType::BORDER;
+
+					const auto& pt1 = vertices[cell.points[(i + 1) % CELL_POINTS_NUMBER]];
+					const auto& pt2 = vertices[cell.points[(i + 2) % CELL_POINTS_NUMBER]];
+					const point::Point2d center = (pt1 + pt2) / 2.0;
+					// Fracture center lies on the face, its wall is half of the aperture away
+					const double dist_nebr = (type == FaceType::FRAC) ? beta.dist[0] : point::distance(beta.c, center);
+					faces.push_back({ cell_idx, nebr_idx, cell.dist[i], dist_nebr, cell.length[i], type });
+					cellFaces[CELL_POINTS_NUMBER * cell_idx + i] = faces.size() - 1;
 				}
-				++cellIter;
 			}
 
-			// Setting type to fracture cells
-			typedef Triangulation::Point CgalPoint2;
-			typedef CGAL::Polygon_2<K, std::vector<CgalPoint2>>	Polygon;
-			Polygon frac;
-			for (const auto& con : task.bodies[0].constraint)
-				frac.push_back(CgalPoint2(con.first[0], con.first[1]));
-
-			cell_idx = 0;
-			for (auto cellIter = triangulation.finite_faces_begin(); cellIter != triangulation.finite_faces_end(); ++cellIter)
+			buildWellFaces();
+			buildConstrainedFaces();
+		};
+		// Faces of the well in the order of wellNebrs
+		void buildWellFaces()
+		{
+			wellFaces.resize(wellNebrs.size());
+			// Cell may touch the well by several faces, they are taken in the order of wellNebrs
+			std::vector<int> used(inner_cells, 0);
+			for (size_t k = 0; k < wellNebrs.size(); k++)
 			{
-				auto& cell = cells[cell_idx];
-				CgalPoint2 center(cell.c.x, cell.c.y);
-				if (!frac.has_on_unbounded_side(center))
+				const auto& nebr = wellNebrs[k];
+				const auto& cell = cells[nebr.id];
+				if (wellModel == WELL_MODEL::PEACEMAN)
+				{
+					// Zero distance on the well side, so only the cell permeability enters the well index
+					faces.push_back({ nebr.id, well_idx, nebr.dist, 0.0, nebr.length, FaceType::WELL });
+					wellFaces[k] = faces.size() - 1;
+				}
+				else if (cell.type == CellType::CONSTRAINED)
+				{
+					// Fracture wall is half of the aperture away from its center
+					faces.push_back({ nebr.id, well_idx, cell.dist[0], nebr.dist, nebr.length, FaceType::WELL });
+					wellFaces[k] = faces.size() - 1;
+				}
+				else
 				{
-					cell.type = CellType::FRAC;
-					fracCells.push_back(&cell);
+					int& i = used[cell.id];
+					while (cell.nebr[i] != well_idx)
+						i++;
+					wellFaces[k] = cellFaces[CELL_POINTS_NUMBER * cell.id + i];
+					i++;
 				}
+			}
+		};
+
+		// Matrix faces of 1D fracture cells and junctions between fracture cells sharing a vertex
+		// Junction cross-section is the aperture, distances are halves of the segments
+		void buildConstrainedFaces()
+		{
+			std::vector<std::vector<size_t>> cellJunctions(constrained_edges);
+			std::vector<std::vector<size_t>> vertexCells(vertices.size());
+			for (size_t k = 0; k < constrained_edges; k++)
+				for (int j = 0; j < 2; j++)
+					vertexCells[cells[constrained_beg + k].points[j]].push_back(constrained_beg + k);
+			for (const auto& ids : vertexCells)
+				for (size_t a = 0; a < ids.size(); a++)
+					for (size_t b = a + 1; b < ids.size(); b++)
+					{
+						const auto& cell1 = cells[ids[a]];
+						const auto& cell2 = cells[ids[b]];
+						faces.push_back({ cell1.id, cell2.id, cell1.length[0] / 2.0, cell2.length[0] / 2.0, fracWidth, FaceType::FRAC });
+						cellJunctions[cell1.id - constrained_beg].push_back(faces.size() - 1);
+						cellJunctions[cell2.id - constrained_beg].push_back(faces.size() - 1);
+					}
+
+			std::vector<std::vector<size_t>> cellWellFaces(constrained_edges);
+			for (size_t k = 0; k < wellNebrs.size(); k++)
+				if (cells[wellNebrs[k].id].type == CellType::CONSTRAINED)
+					cellWellFaces[wellNebrs[k].id - constrained_beg].push_back(wellFaces[k]);
 
-				cell_idx++;
+			constrainedPtr.assign(1, 0);
+			constrainedFaces.clear();
+			for (size_t k = 0; k < constrained_edges; k++)
+			{
+				const auto& cell = cells[constrained_beg + k];
+				for (int j = 0; j < 2; j++)
+				{
+					// Sides merged into the MESHED well are connected by the well faces
+					if (cell.nebr[j] == well_idx)
+						continue;
+					const auto& beta = cells[cell.nebr[j]];
+					if (beta.id >= inner_cells || beta.type == CellType::WELL)
+						throw std::runtime_error("1D fracture cell " + std::to_string(cell.id) + " borders the cell " +
+												std::to_string(beta.id) + " without matrix faces");
+					for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+						if (beta.nebr[i] == cell.id)
+							constrainedFaces.push_back(cellFaces[CELL_POINTS_NUMBER * beta.id + i]);
+				}
+				constrainedFaces.insert(constrainedFaces.end(), cellWellFaces[k].begin(), cellWellFaces[k].end());
+				constrainedFaces.insert(constrainedFaces.end(), cellJunctions[k].begin(), cellJunctions[k].end());
+				constrainedPtr.push_back(constrainedFaces.size());
 			}
+		};
 
-			point::Point2d well_pt = { task.bodies[0].well[0], task.bodies[0].well[1] };
-			/*std::vector<CellHandle> well_faces;
-			std::back_insert_iterator<std::vector<CellHandle>> it(well_faces);
-			it = triangulation.get_conflicts(CgalPoint2(well_pt.x, well_pt.y), std::back_inserter(well_faces));
-			well_idx = well_faces[0]->info().id;
-			cells[well_idx].type = CellType::WELL;*/
-
-			cells.push_back(TriangleCell(cells.size()));
-			well_idx = cells.size() - 1;
-			auto& well_cell = cells[cells.size() - 1];
-			well_cell.type = CellType::WELL;
-			well_cell.c = well_pt;
-			well_vol = 0.0;
-			for (auto& fcell : fracCells)
+		// Index of the point on the Hilbert curve filling the n x n grid, n is a power of 2
+		static size_t getHilbertIdx(size_t x, size_t y, const size_t n)
+		{
+			size_t d = 0;
+			for (size_t s = n / 2; s > 0; s /= 2)
 			{
-				const double dist = point::distance(well_pt, fcell->c);
-				if (dist < task.bodies[0].r_w)
+				const size_t rx = (x & s) > 0;
+				const size_t ry = (y & s) > 0;
+				d += s * s * ((3 * rx) ^ ry);
+				if (ry == 0)
 				{
-					fcell->type = CellType::WELL;
-					wellCells.push_back(fcell);
-					well_vol += fcell->V;
+					if (rx == 1)
+					{
+						x = n - 1 - x;
+						y = n - 1 - y;
+					}
+					std::swap(x, y);
 				}
 			}
-			cellIter = triangulation.finite_faces_begin();
-			for (size_t cell_idx = 0; cell_idx < inner_cells; cell_idx++)
+			return d;
+		};
+		// Inner cells in the reverse Cuthill-McKee order
+		void getRcmOrder(std::vector<size_t>& order) const
+		{
+			auto getDegree = [this](const size_t id)
+			{
+				int degree = 0;
+				for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+					degree += (cells[id].nebr[i] < inner_cells);
+				return degree;
+			};
+
+			order.clear();
+			std::vector<bool> isVisited(inner_cells, false);
+			std::vector<size_t> nebrs;
+			// Breadth-first search from the start cell, returns the last reached cell
+			auto bfs = [&](const size_t start, std::vector<size_t>& level)
 			{
-				auto& cell = cells[cell_idx];
-				if (cell.type == CellType::INNER || cell.type == CellType::FRAC)
+				level.clear();
+				std::queue<size_t> q;
+				q.push(start);
+				isVisited[start] = true;
+				while (!q.empty())
 				{
-					for (size_t i = 0; i < CELL_POINTS_NUMBER; i++)
-						if (cells[cell.nebr[i]].type == CellType::WELL)
+					const size_t id = q.front();
+					q.pop();
+					level.push_back(id);
+
+					nebrs.clear();
+					for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+					{
+						const size_t nebr = cells[id].nebr[i];
+						if (nebr < inner_cells && !isVisited[nebr])
 						{
-							cell.nebr[i] = cells.size() - 1;
-							const point::Point2d& pt1 = { cellIter->vertex(cellIter->cw(i))->point()[0], cellIter->vertex(cellIter->cw(i))->point()[1] };
-							const point::Point2d& pt2 = { cellIter->vertex(cellIter->ccw(i))->point()[0], cellIter->vertex(cellIter->ccw(i))->point()[1] };
-							wellNebrs.push_back({ cell.id, cell.length[i], point::distance(well_cell.c, (pt1 + pt2) / 2.0) });
+							isVisited[nebr] = true;
+							nebrs.push_back(nebr);
 						}
+					}
+					std::sort(nebrs.begin(), nebrs.end(), [&](const size_t a, const size_t b) { return getDegree(a) < getDegree(b); });
+					for (const auto nebr : nebrs)
+						q.push(nebr);
 				}
-				++cellIter;
+				return level.back();
+			};
+
+			std::vector<size_t> level;
+			for (size_t i = 0; i < inner_cells; i++)
+			{
+				if (isVisited[i])
+					continue;
+
+				// Pseudo-peripheral start is the farthest cell of the component
+				const size_t far = bfs(i, level);
+				for (const auto id : level)
+					isVisited[id] = false;
+				bfs(far, level);
+				order.insert(order.end(), level.begin(), level.end());
+			}
+			std::reverse(order.begin(), order.end());
+		};
+		// Inner cells sorted along the Hilbert curve passing through the cell centers
+		void getHilbertOrder(std::vector<size_t>& order) const
+		{
+			const size_t n = size_t(1) << 16;
+			point::Point2d min = cells[0].c, max = cells[0].c;
+			for (size_t i = 0; i < inner_cells; i++)
+			{
+				min.x = std::min(min.x, cells[i].c.x);		min.y = std::min(min.y, cells[i].c.y);
+				max.x = std::max(max.x, cells[i].c.x);		max.y = std::max(max.y, cells[i].c.y);
 			}
+			const double scale = (n - 1) / std::max(std::max(max.x - min.x, max.y - min.y), EQUALITY_TOLERANCE);
+
+			std::vector<size_t> keys(inner_cells);
+			for (size_t i = 0; i < inner_cells; i++)
+				keys[i] = getHilbertIdx(size_t((cells[i].c.x - min.x) * scale), size_t((cells[i].c.y - min.y) * scale), n);
+
+			order.resize(inner_cells);
+			for (size_t i = 0; i < inner_cells; i++)
+				order[i] = i;
+			std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return keys[a] < keys[b]; });
+		};
+		// Permutes cells and vertices, inner cells are kept first, border cells next and the well cell last
+		void renumber(const ORDERING type)
+		{
+			if (type == ORDERING::NATIVE)
+				return;
 
+			const size_t bandwidth = getBandwidth(), profile = getProfile();
 
-			// Creating constrained cells
-/*			constrained_beg = cells.size();
-			cellIter = triangulation.finite_faces_begin();
-			for (int cell_idx = 0; cell_idx < inner_cells; cell_idx++)
+			std::vector<size_t> order;
+			if (type == ORDERING::RCM)
+				getRcmOrder(order);
+			else
+				getHilbertOrder(order);
+
+			// Old to new cell indices
+			std::vector<size_t> perm(cells.size());
+			for (size_t i = 0; i < inner_cells; i++)
+				perm[order[i]] = i;
+			// Border and 1D fracture cells follow their inner neighbours inside their ranges
+			auto sortRange = [&](const size_t beg, const size_t num)
+			{
+				order.clear();
+				for (size_t i = beg; i < beg + num; i++)
+					order.push_back(i);
+				std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return perm[cells[a].nebr[0]] < perm[cells[b].nebr[0]]; });
+				for (size_t i = 0; i < order.size(); i++)
+					perm[order[i]] = beg + i;
+			};
+			// 1D fracture cells next to the MESHED well may have it as the first neighbour
+			perm[well_idx] = well_idx;
+			sortRange(border_beg, border_edges - symmetry_edges);
+			sortRange(border_beg + border_edges - symmetry_edges, symmetry_edges);
+			sortRange(constrained_beg, constrained_edges);
+
+			std::vector<TriangleCell> newCells(cells.size());
+			for (auto& cell : cells)
 			{
-				auto& cell = cells[cell_idx];
-				if (cell.type == CellType::CONSTRAINED)
+				if (cell.id < inner_cells)
+					for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+						cell.nebr[i] = perm[cell.nebr[i]];
+				else if (cell.type == CellType::BORDER)
+					cell.nebr[0] = perm[cell.nebr[0]];
+				else if (cell.type == CellType::CONSTRAINED)
 				{
-					const int nebr_idx = constrainedCells[constrained_edges].second;
-					const auto nebrIter = cellIter->neighbor(nebr_idx);
-					const int nebr_id = nebrIter->info().id;
-					auto& nebr = cells[nebrIter->info().id];
-					cell.type = nebr.type = CellType::INNER;
-
-					cells.push_back(TriangleCell(constrained_beg + constrained_edges));
-					TriangleCell& edge = cells[cells.size() - 1];
-					edge.type = CellType::CONSTRAINED;
-					const Point2d& p1 = { cellIter->vertex(cellIter->cw(nebr_idx))->point()[0], cellIter->vertex(cellIter->cw(nebr_idx))->point()[1] };
-					const Point2d& p2 = { cellIter->vertex(cellIter->ccw(nebr_idx))->point()[0], cellIter->vertex(cellIter->ccw(nebr_idx))->point()[1] };
-					edge.c = (p1 + p2) / 2.0;
-					edge.V = point::distance(p1, p2);
-					edge.nebr[0] = cell_idx;		edge.nebr[1] = nebr.id;
-					edge.points[0] = cellIter->vertex(cellIter->cw(nebr_idx))->info();
-					edge.points[1] = cellIter->vertex(cellIter->ccw(nebr_idx))->info();
-
-					cell.nebr[nebr_idx] = constrained_beg + constrained_edges;
+					cell.nebr[0] = perm[cell.nebr[0]];
+					cell.nebr[1] = perm[cell.nebr[1]];
+				}
+				cell.id = perm[cell.id];
+				newCells[cell.id] = cell;
+			}
+			cells.swap(newCells);
+			for (auto& nebr : wellNebrs)
+				nebr.id = perm[nebr.id];
+			for (auto& id : fracCells)
+				id = perm[id];
+			for (auto& id : wellCells)
+				id = perm[id];
+
+			// Vertices are numbered in the order of their first appearance in cells
+			const size_t unset = vertices.size();
+			std::vector<size_t> vperm(vertices.size(), unset);
+			size_t vertex_idx = 0;
+			for (auto& cell : cells)
+			{
+				const int pointsNum = (cell.id < inner_cells) ? CELL_POINTS_NUMBER : (cell.type == CellType::BORDER || cell.type == CellType::CONSTRAINED ? 2 : 0);
+				for (int i = 0; i < pointsNum; i++)
+				{
+					if (vperm[cell.points[i]] == unset)
+						vperm[cell.points[i]] = vertex_idx++;
+					cell.points[i] = vperm[cell.points[i]];
+				}
+			}
+			for (auto& idx : vperm)
+				if (idx == unset)
+					idx = vertex_idx++;
+			std::vector<point::Point2d> newVertices(vertices.size());
+			for (size_t i = 0; i < vertices.size(); i++)
+				newVertices[vperm[i]] = vertices[i];
+			vertices.swap(newVertices);
+
+			std::cout << "Cells renumbering: bandwidth " << bandwidth << " -> " << getBandwidth() <<
+				", profile " << profile << " -> " << getProfile() << std::endl;
+		};
+		// Binary cache of the processed mesh
+		// Triangulation itself is not stored, only the data used by models and snapshotters
+		static const unsigned int CACHE_VERSION = 5;
+		struct CacheHeader
+		{
+			unsigned int version;
+			int wellModel;
+			unsigned long long verticesNum, cellsNum, wellNebrsNum, fracNum, wellCellsNum;
+			unsigned long long inner_cells, border_edges, border_beg, symmetry_edges, constrained_edges, constrained_beg, well_idx;
+			double well_vol, Volume, fracWidth;
+		};
+		struct CellRecord
+		{
+			unsigned long long id, nebr[3], points[3];
+			double dist[3], length[3];
+			double c[2], V;
+			int type;
+		};
+		std::string getCacheFileName(const Task& task) const
+		{
+			const unsigned int version = CACHE_VERSION;
+			unsigned long long hash = hashBytes(&version, sizeof(version));
+			hash = hashBytes(&height, sizeof(height), hash);
+			hash = hashBytes(&task.spatialStep, sizeof(task.spatialStep), hash);
+			hash = hashBytes(&task.minStep, sizeof(task.minStep), hash);
+			hash = hashBytes(&task.stepGrowth, sizeof(task.stepGrowth), hash);
+			hash = hashBytes(&task.ordering, sizeof(task.ordering), hash);
+			hash = hashBytes(&task.incrementalMeshing, sizeof(task.incrementalMeshing), hash);
+			if (!task.symmetryPlanes.empty())
+				hash = hashBytes(&task.symmetryPlanes[0], task.symmetryPlanes.size() * sizeof(task.symmetryPlanes[0]), hash);
+			for (const auto& body : task.bodies)
+			{
+				hash = hashBytes(&body.id, sizeof(body.id), hash);
+				hash = hashBytes(&body.r_w, sizeof(body.r_w), hash);
+				hash = hashBytes(&body.well, sizeof(body.well), hash);
+				hash = hashBytes(&body.wellModel, sizeof(body.wellModel), hash);
+				if (!body.outer.empty())
+					hash = hashBytes(&body.outer[0], body.outer.size() * sizeof(body.outer[0]), hash);
+				for (const auto& border : body.inner)
+					if (!border.empty())
+						hash = hashBytes(&border[0], border.size() * sizeof(border[0]), hash);
+				if (!body.constraint.empty())
+					hash = hashBytes(&body.constraint[0], body.constraint.size() * sizeof(body.constraint[0]), hash);
+				if (!body.fractures.empty())
+					hash = hashBytes(&body.fractures[0], body.fractures.size() * sizeof(body.fractures[0]), hash);
+				hash = hashBytes(&body.fracWidth, sizeof(body.fracWidth), hash);
+			}
+			return "snaps/mesh_" + std::to_string(hash) + ".bin";
+		};
+		void saveCache(const std::string& fileName) const
+		{
+			std::ofstream file(fileName, std::ofstream::binary);
+			if (!file.is_open())
+				return;
+
+			const CacheHeader header = { CACHE_VERSION, static_cast<int>(wellModel), vertices.size(), cells.size(), wellNebrs.size(), fracCells.size(), wellCells.size(),
+										inner_cells, border_edges, border_beg, symmetry_edges, constrained_edges, constrained_beg, well_idx, well_vol, Volume, fracWidth };
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (const auto& pt : vertices)
+				file.write(reinterpret_cast<const char*>(pt.coords), sizeof(pt.coords));
+			for (const auto& cell : cells)
+			{
+				CellRecord rec;
+				std::memset(&rec, 0, sizeof(rec));
+				rec.id = cell.id;
+				const int pointsNum = (cell.id < inner_cells) ? CELL_POINTS_NUMBER : (cell.type == CellType::BORDER || cell.type == CellType::CONSTRAINED ? 2 : 0);
+				const int nebrsNum = (cell.id < inner_cells) ? CELL_POINTS_NUMBER : (cell.type == CellType::BORDER ? 1 : (cell.type == CellType::CONSTRAINED ? 2 : 0));
+				for (int i = 0; i < nebrsNum; i++)
+					rec.nebr[i] = cell.nebr[i];
+				for (int i = 0; i < pointsNum; i++)
+					rec.points[i] = cell.points[i];
+				if (cell.id < inner_cells || cell.type == CellType::CONSTRAINED)
 					for (int i = 0; i < CELL_POINTS_NUMBER; i++)
-						if (nebr.nebr[i] == cell.id)
-							nebr.nebr[i] = cell.nebr[nebr_idx];
-
-					constrained_edges++;
+					{
+						rec.dist[i] = cell.dist[i];
+						rec.length[i] = cell.length[i];
+					}
+				rec.c[0] = cell.c.x;		rec.c[1] = cell.c.y;
+				rec.V = cell.V;
+				rec.type = cell.type;
+				file.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+			}
+			if (!wellNebrs.empty())
+				file.write(reinterpret_cast<const char*>(&wellNebrs[0]), wellNebrs.size() * sizeof(WellNebr));
+			for (const auto cell_idx : fracCells)
+			{
+				const unsigned long long id = cell_idx;
+				file.write(reinterpret_cast<const char*>(&id), sizeof(id));
+			}
+			for (const auto cell_idx : wellCells)
+			{
+				const unsigned long long id = cell_idx;
+				file.write(reinterpret_cast<const char*>(&id), sizeof(id));
+			}
+		};
+		bool loadCache(const std::string& fileName)
+		{
+			std::ifstream file(fileName, std::ifstream::binary | std::ifstream::ate);
+			if (!file.is_open())
+				return false;
+			const size_t fileSize = static_cast<size_t>(file.tellg());
+			file.seekg(0);
+
+			CacheHeader header;
+			if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+				return false;
+			const size_t expected = sizeof(CacheHeader) + header.verticesNum * 2 * sizeof(double) + header.cellsNum * sizeof(CellRecord) +
+				header.wellNebrsNum * sizeof(WellNebr) + (header.fracNum + header.wellCellsNum) * sizeof(unsigned long long);
+			if (header.version != CACHE_VERSION || fileSize != expected)
+				return false;
+
+			// Records are read by blocks and converted to the runtime layout
+			std::vector<double> coords(2 * header.verticesNum);
+			std::vector<CellRecord> records(header.cellsNum);
+			std::vector<unsigned long long> ids(header.fracNum + header.wellCellsNum);
+			wellNebrs.resize(header.wellNebrsNum);
+			if (!coords.empty())
+				file.read(reinterpret_cast<char*>(&coords[0]), coords.size() * sizeof(double));
+			if (!records.empty())
+				file.read(reinterpret_cast<char*>(&records[0]), records.size() * sizeof(CellRecord));
+			if (!wellNebrs.empty())
+				file.read(reinterpret_cast<char*>(&wellNebrs[0]), wellNebrs.size() * sizeof(WellNebr));
+			if (!ids.empty())
+				file.read(reinterpret_cast<char*>(&ids[0]), ids.size() * sizeof(unsigned long long));
+			if (!file)
+				return false;
+
+			vertices.resize(header.verticesNum);
+			for (size_t i = 0; i < vertices.size(); i++)
+				vertices[i] = { coords[2 * i], coords[2 * i + 1] };
+			cells.resize(header.cellsNum);
+			for (size_t k = 0; k < cells.size(); k++)
+			{
+				const CellRecord& rec = records[k];
+				auto& cell = cells[k];
+				cell.id = rec.id;
+				for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+				{
+					cell.nebr[i] = rec.nebr[i];
+					cell.points[i] = rec.points[i];
+					cell.dist[i] = rec.dist[i];
+					cell.length[i] = rec.length[i];
 				}
+				cell.c = { rec.c[0], rec.c[1] };
+				cell.V = rec.V;
+				cell.type = static_cast<CellType>(rec.type);
+			}
+			fracCells.assign(ids.begin(), ids.begin() + header.fracNum);
+			wellCells.assign(ids.begin() + header.fracNum, ids.end());
 
-				++cellIter;
-			}*/
+			inner_cells = header.inner_cells;
+			inner_beg = 0;
+			border_edges = header.border_edges;
+			border_beg = header.border_beg;
+			symmetry_edges = header.symmetry_edges;
+			constrained_edges = header.constrained_edges;
+			constrained_beg = header.constrained_beg;
+			fracWidth = header.fracWidth;
+			well_idx = header.well_idx;
+			wellModel = static_cast<WELL_MODEL>(header.wellModel);
+			well_vol = header.well_vol;
+			Volume = header.Volume;
+			return true;
 		};
 	public:
-		TriangleMesh() { Volume = 0.0; };
+		TriangleMesh() : height(0.0) {};
 		TriangleMesh(const Task& task, const double _height) : height(_height)
 		{
-			Volume = 0.0;
-			load(task);
+			symmetryPlanes = task.symmetryPlanes;
+			symmetryFactor = TriangleMeshBuilder::getSymmetryFactor(task);
+			const std::string fileName = getCacheFileName(task);
+			if (!task.cacheMesh || !loadCache(fileName))
+			{
+				TriangleMeshBuilder::build(task, height, *this);
+				renumber(task.ordering);
+				if (task.cacheMesh)
+					saveCache(fileName);
+			}
+			buildFaces();
 		};
 		~TriangleMesh() {};
 
@@ -321,7 +614,63 @@ namespace mesh
 		}
 		size_t getVerticesSize() const
 		{
-			return vertexHandles.size();
+			return vertices.size();
+		}
+		// Maximum distance between the indices of connected cells
+		size_t getBandwidth() const
+		{
+			size_t bandwidth = 0;
+			for (const auto& cell : cells)
+				if (cell.id < inner_cells)
+					for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+						bandwidth = std::max(bandwidth, (cell.nebr[i] > cell.id) ? cell.nebr[i] - cell.id : cell.id - cell.nebr[i]);
+			for (const auto& nebr : wellNebrs)
+				bandwidth = std::max(bandwidth, well_idx - nebr.id);
+			return bandwidth;
+		}
+		// Sum of distances from the diagonal to the first connected cell over rows
+		size_t getProfile() const
+		{
+			std::vector<size_t> first(cells.size());
+			for (size_t i = 0; i < cells.size(); i++)
+				first[i] = i;
+			for (const auto& cell : cells)
+				if (cell.id < inner_cells)
+					for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+					{
+						first[cell.id] = std::min(first[cell.id], cell.nebr[i]);
+						first[cell.nebr[i]] = std::min(first[cell.nebr[i]], cell.id);
+					}
+			for (const auto& nebr : wellNebrs)
+				first[well_idx] = std::min(first[well_idx], nebr.id);
+
+			size_t profile = 0;
+			for (size_t i = 0; i < cells.size(); i++)
+				profile += i - first[i];
+			return profile;
+		}
+		// Hash of the cells connectivity
+		unsigned long long getHash() const
+		{
+			unsigned long long hash = hashBytes(&well_idx, sizeof(well_idx));
+			hash = hashBytes(&wellModel, sizeof(wellModel), hash);
+			for (const auto& cell : cells)
+			{
+				hash = hashBytes(&cell.type, sizeof(cell.type), hash);
+				if (cell.id < inner_cells)
+					hash = hashBytes(cell.nebr, sizeof(cell.nebr), hash);
+				else if (cell.type == CellType::BORDER)
+					hash = hashBytes(&cell.nebr[0], sizeof(cell.nebr[0]), hash);
+				else if (cell.type == CellType::CONSTRAINED)
+				{
+					// Fracture junctions come from the shared vertices
+					hash = hashBytes(cell.nebr, 2 * sizeof(cell.nebr[0]), hash);
+					hash = hashBytes(cell.points, 2 * sizeof(cell.points[0]), hash);
+				}
+			}
+			for (const auto& nebr : wellNebrs)
+				hash = hashBytes(&nebr.id, sizeof(nebr.id), hash);
+			return hash;
 		}
 	};
 };
@@ -0,0 +1,538 @@
+#include "src/mesh/TriangleMeshBuilder.h"
+
+#include <set>
+#include <stdexcept>
+#include <CGAL/Triangle_2.h>
+
+#include "src/mesh/CGALMesher.hpp"
+#include "src/mesh/PolygonIndex.hpp"
+
+using namespace mesh;
+
+namespace
+{
+	struct CellInfo
+	{
+		size_t id;
+	};
+	typedef size_t VertexInfo;
+
+	typedef CGAL::Exact_predicates_inexact_constructions_kernel        K;
+	typedef CGAL::Triangulation_vertex_base_with_info_2<VertexInfo, K> Vb;
+	typedef CGAL::Triangulation_face_base_with_info_2<CellInfo, K>     Cb;
+	typedef CGAL::Triangulation_data_structure_2<Vb, Cb>               Tds;
+	typedef CGAL::Delaunay_triangulation_2<K, Tds>                     Triangulation;
+	typedef Triangulation::Vertex_handle                               VertexHandle;
+
+	typedef Task::Body::Point Point;
+	typedef Task::Body::Edge Edge;
+	/// Positive on the left of the directed line, scaled by the line length
+	double getSide(const Point& p, const Edge& line)
+	{
+		return (line.second[0] - line.first[0]) * (p[1] - line.first[1]) - (line.second[1] - line.first[1]) * (p[0] - line.first[0]);
+	};
+	/// Points closer to the line are taken as lying on it
+	double getTolerance(const Edge& line)
+	{
+		const double dx = line.second[0] - line.first[0], dy = line.second[1] - line.first[1];
+		return 1.E-8 * (dx * dx + dy * dy);
+	};
+	typedef std::pair<point::Point2d, point::Point2d> Segment;
+	/// Distance from the point to the segment
+	double getDistance(const point::Point2d& p, const Segment& seg)
+	{
+		const point::Point2d d = seg.second - seg.first;
+		const double len2 = d.x * d.x + d.y * d.y;
+		double t = ((p.x - seg.first.x) * d.x + (p.y - seg.first.y) * d.y) / len2;
+		t = std::max(0.0, std::min(1.0, t));
+		return point::distance(p, seg.first + t * d);
+	};
+	Point getIntersection(const Point& a, const Point& b, const Edge& line)
+	{
+		const double sa = getSide(a, line), sb = getSide(b, line);
+		const double t = sa / (sa - sb);
+		return { a[0] + t * (b[0] - a[0]), a[1] + t * (b[1] - a[1]) };
+	};
+	/// Sutherland-Hodgman clipping of the closed polygon by the left half-plane
+	std::vector<Point> clipPolygon(const std::vector<Point>& pts, const Edge& line)
+	{
+		const double tol = getTolerance(line);
+		std::vector<Point> res;
+		for (size_t i = 0; i < pts.size(); i++)
+		{
+			const Point& a = pts[i];
+			const Point& b = pts[(i + 1) % pts.size()];
+			const double sa = getSide(a, line), sb = getSide(b, line);
+			if (sa >= -tol)
+				res.push_back(a);
+			if ((sa > tol && sb < -tol) || (sa < -tol && sb > tol))
+				res.push_back(getIntersection(a, b, line));
+		}
+		return res;
+	};
+	/// Constraints are chains of closed loops, every loop is clipped as a polygon
+	std::vector<Edge> clipLoops(const std::vector<Edge>& constraint, const Edge& line)
+	{
+		std::vector<Edge> res;
+		std::vector<Point> pts;
+		auto addLoop = [&]()
+		{
+			const auto clipped = clipPolygon(pts, line);
+			if (clipped.size() > 2)
+				for (size_t i = 0; i < clipped.size(); i++)
+					res.push_back({ clipped[i], clipped[(i + 1) % clipped.size()] });
+			pts.clear();
+		};
+		for (const auto& con : constraint)
+		{
+			pts.push_back(con.first);
+			if (con.second == pts[0])
+				addLoop();
+		}
+		if (pts.size() > 2)
+			addLoop();
+		return res;
+	};
+	std::vector<Edge> clipSegments(const std::vector<Edge>& segments, const Edge& line)
+	{
+		const double tol = getTolerance(line);
+		std::vector<Edge> res;
+		for (const auto& seg : segments)
+		{
+			const double sa = getSide(seg.first, line), sb = getSide(seg.second, line);
+			if (sa >= -tol && sb >= -tol)
+				res.push_back(seg);
+			else if (sa > tol)
+				res.push_back({ seg.first, getIntersection(seg.first, seg.second, line) });
+			else if (sb > tol)
+				res.push_back({ getIntersection(seg.first, seg.second, line), seg.second });
+		}
+		return res;
+	};
+	double getArea(const std::vector<Point>& pts)
+	{
+		double area = 0.0;
+		for (size_t i = 0; i < pts.size(); i++)
+		{
+			const Point& a = pts[i];
+			const Point& b = pts[(i + 1) % pts.size()];
+			area += a[0] * b[1] - b[0] * a[1];
+		}
+		return fabs(area) / 2.0;
+	};
+};
+
+Task TriangleMeshBuilder::getSector(const Task& task)
+{
+	Task sector = task;
+	for (const auto& line : task.symmetryPlanes)
+		for (auto& body : sector.bodies)
+		{
+			body.outer = clipPolygon(body.outer, line);
+			std::vector<Task::Body::Border> inner;
+			for (const auto& cavity : body.inner)
+			{
+				auto clipped = clipPolygon(cavity, line);
+				if (clipped.size() > 2)
+					inner.push_back(clipped);
+			}
+			body.inner = inner;
+			body.constraint = clipLoops(body.constraint, line);
+			body.fractures = clipSegments(body.fractures, line);
+		}
+	return sector;
+}
+double TriangleMeshBuilder::getSymmetryFactor(const Task& task)
+{
+	if (task.symmetryPlanes.empty())
+		return 1.0;
+	return getArea(task.bodies[0].outer) / getArea(getSector(task).bodies[0].outer);
+}
+void TriangleMeshBuilder::setSymmetryBorder(const Task& task, MeshData& data)
+{
+	auto& cells = data.cells;
+	const size_t border_end = data.border_beg + data.border_edges;
+	auto isOnLine = [&](const point::Point2d& p)
+	{
+		for (const auto& line : task.symmetryPlanes)
+			if (fabs(getSide({ p.x, p.y }, line)) < getTolerance(line))
+				return true;
+		return false;
+	};
+
+	/// Border cells on the symmetry lines are moved to the end of the border range
+	std::vector<size_t> order, symmetry;
+	for (size_t i = data.border_beg; i < border_end; i++)
+	{
+		const auto& cell = cells[i];
+		if (isOnLine(data.vertices[cell.points[0]]) && isOnLine(data.vertices[cell.points[1]]))
+			symmetry.push_back(i);
+		else
+			order.push_back(i);
+	}
+	data.symmetry_edges = symmetry.size();
+	if (symmetry.empty())
+		return;
+	order.insert(order.end(), symmetry.begin(), symmetry.end());
+
+	std::vector<size_t> perm(cells.size());
+	for (size_t i = 0; i < cells.size(); i++)
+		perm[i] = i;
+	for (size_t i = 0; i < order.size(); i++)
+		perm[order[i]] = data.border_beg + i;
+
+	for (size_t cell_idx = 0; cell_idx < data.inner_cells; cell_idx++)
+		for (int i = 0; i < MeshData::CELL_POINTS_NUMBER; i++)
+			cells[cell_idx].nebr[i] = perm[cells[cell_idx].nebr[i]];
+	std::vector<TriangleCell> border(cells.begin() + data.border_beg, cells.begin() + border_end);
+	for (auto& cell : border)
+	{
+		cell.id = perm[cell.id];
+		cells[cell.id] = cell;
+	}
+}
+
+void TriangleMeshBuilder::setConstrainedCells(const Task& task, const double height, MeshData& data)
+{
+	const int CELL_POINTS_NUMBER = MeshData::CELL_POINTS_NUMBER;
+	auto& cells = data.cells;
+	data.constrained_beg = cells.size();
+	data.constrained_edges = 0;
+	data.fracWidth = task.bodies[0].fracWidth;
+
+	std::vector<Segment> segments;
+	for (const auto& b : task.bodies)
+		for (const auto& con : b.fractures)
+			segments.push_back({ { con.first[0], con.first[1] }, { con.second[0], con.second[1] } });
+	if (segments.empty())
+		return;
+
+	/// Mesher splits constraints, so the edge lies on the fracture if both its ends do
+	auto isOnFracture = [&](const point::Point2d& p1, const point::Point2d& p2)
+	{
+		for (const auto& seg : segments)
+		{
+			const double tol = 1.E-8 * point::distance(seg.first, seg.second);
+			if (getDistance(p1, seg) < tol && getDistance(p2, seg) < tol)
+				return true;
+		}
+		return false;
+	};
+
+	for (size_t cell_idx = 0; cell_idx < data.inner_cells; cell_idx++)
+	{
+		for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+		{
+			const size_t nebr_idx = cells[cell_idx].nebr[i];
+			if (nebr_idx >= data.inner_cells || nebr_idx < cell_idx)
+				continue;
+
+			const size_t pt1 = cells[cell_idx].points[(i + 1) % CELL_POINTS_NUMBER];
+			const size_t pt2 = cells[cell_idx].points[(i + 2) % CELL_POINTS_NUMBER];
+			const auto& p1 = data.vertices[pt1];
+			const auto& p2 = data.vertices[pt2];
+			if (!isOnFracture(p1, p2))
+				continue;
+
+			TriangleCell edge(cells.size());
+			edge.type = CellType::CONSTRAINED;
+			edge.c = (p1 + p2) / 2.0;
+			edge.V = point::distance(p1, p2) * data.fracWidth * height;
+			edge.nebr[0] = cell_idx;		edge.nebr[1] = nebr_idx;
+			edge.points[0] = pt1;			edge.points[1] = pt2;
+			for (int j = 0; j < CELL_POINTS_NUMBER; j++)
+			{
+				edge.dist[j] = data.fracWidth / 2.0;
+				edge.length[j] = point::distance(p1, p2);
+			}
+
+			/// Matrix cells on both sides are connected through the fracture only
+			cells[cell_idx].nebr[i] = edge.id;
+			for (int j = 0; j < CELL_POINTS_NUMBER; j++)
+				if (cells[nebr_idx].nebr[j] == cell_idx)
+					cells[nebr_idx].nebr[j] = edge.id;
+			cells.push_back(edge);
+			data.constrained_edges++;
+		}
+	}
+}
+void TriangleMeshBuilder::setPerforations(const Task::Body& body, const double height, MeshData& data)
+{
+	const int CELL_POINTS_NUMBER = MeshData::CELL_POINTS_NUMBER;
+	const point::Point2d well_pt = { body.well[0], body.well[1] };
+	for (size_t cell_idx = 0; cell_idx < data.inner_cells; cell_idx++)
+	{
+		const auto& cell = data.cells[cell_idx];
+		const auto& a = data.vertices[cell.points[0]];
+		const auto& b = data.vertices[cell.points[1]];
+		const auto& c = data.vertices[cell.points[2]];
+
+		// Barycentric coordinates of the well point
+		const double det = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+		double bar[3];
+		bar[1] = ((well_pt.x - a.x) * (c.y - a.y) - (c.x - a.x) * (well_pt.y - a.y)) / det;
+		bar[2] = ((b.x - a.x) * (well_pt.y - a.y) - (well_pt.x - a.x) * (b.y - a.y)) / det;
+		bar[0] = 1.0 - bar[1] - bar[2];
+		const double eps = 1.E-10;
+		if (bar[0] < -eps || bar[1] < -eps || bar[2] < -eps)
+			continue;
+
+		/// Angle of the cell seen from the well: full circle inside the cell,
+		/// half of it on the edge and the cell angle in the vertex
+		int zeros = 0, vertex = 0;
+		for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+		{
+			if (fabs(bar[i]) < eps)
+				zeros++;
+			else
+				vertex = i;
+		}
+		double angle = 2.0 * M_PI;
+		if (zeros == 1)
+			angle = M_PI;
+		else if (zeros == 2)
+		{
+			const auto& pt = data.vertices[cell.points[vertex]];
+			const auto& pt1 = data.vertices[cell.points[(vertex + 1) % CELL_POINTS_NUMBER]];
+			const auto& pt2 = data.vertices[cell.points[(vertex + 2) % CELL_POINTS_NUMBER]];
+			const double d1 = point::distance(pt, pt1), d2 = point::distance(pt, pt2);
+			angle = acos(((pt1.x - pt.x) * (pt2.x - pt.x) + (pt1.y - pt.y) * (pt2.y - pt.y)) / d1 / d2);
+		}
+
+		/// Peaceman radius r_o = 0.2 * dx of the square cell, the cell area is extended to the full circle
+		const double r_o = 0.2 * sqrt(cell.V / height * 2.0 * M_PI / angle);
+		/// Model is valid for cells much larger than the wellbore
+		data.wellNebrs.push_back({ cell.id, angle, log(std::max(r_o / body.r_w, 2.0)) });
+		data.well_vol += cell.V;
+	}
+}
+void TriangleMeshBuilder::setFractureWell(const Task::Body& body, MeshData& data)
+{
+	auto& cells = data.cells;
+	const point::Point2d well_pt = { body.well[0], body.well[1] };
+	for (size_t k = 0; k < data.constrained_edges; k++)
+	{
+		auto& edge = cells[data.constrained_beg + k];
+		if (data.wellModel == WELL_MODEL::MESHED)
+		{
+			/// Sides merged into the well are replaced by the well itself, the face is the edge
+			for (int j = 0; j < 2; j++)
+				if (cells[edge.nebr[j]].type == CellType::WELL)
+				{
+					edge.nebr[j] = data.well_idx;
+					data.wellNebrs.push_back({ edge.id, edge.length[0], point::distance(well_pt, edge.c) });
+				}
+		}
+		else
+		{
+			const Segment seg = { data.vertices[edge.points[0]], data.vertices[edge.points[1]] };
+			if (getDistance(well_pt, seg) >= body.r_w)
+				continue;
+
+			/// Half-cell transmissibility along the fracture from its center to the wellbore,
+			/// cross-section is the aperture
+			data.wellNebrs.push_back({ edge.id, data.fracWidth, std::max(point::distance(well_pt, edge.c), body.r_w) });
+			data.well_vol += edge.V;
+		}
+	}
+
+	if (data.wellNebrs.empty() || data.well_vol <= 0.0)
+	{
+		if (data.wellModel == WELL_MODEL::MESHED)
+			throw std::runtime_error("MESHED well has no fracture cells within r_w, refine the mesh near the well or use the PEACEMAN model");
+		else
+			throw std::runtime_error("PEACEMAN well point lies outside the mesh");
+	}
+}
+void TriangleMeshBuilder::build(const Task& fullTask, const double height, MeshData& data)
+{
+	const Task task = getSector(fullTask);
+	const int CELL_POINTS_NUMBER = MeshData::CELL_POINTS_NUMBER;
+	auto& cells = data.cells;
+	auto& vertices = data.vertices;
+	auto& fracCells = data.fracCells;
+	auto& wellCells = data.wellCells;
+	auto& wellNebrs = data.wellNebrs;
+	size_t& inner_cells = data.inner_cells;
+	size_t& inner_beg = data.inner_beg;
+	size_t& border_edges = data.border_edges;
+	size_t& border_beg = data.border_beg;
+	size_t& well_idx = data.well_idx;
+	WELL_MODEL& wellModel = data.wellModel;
+	double& well_vol = data.well_vol;
+	double& Volume = data.Volume;
+
+	Triangulation triangulation;
+	std::vector<VertexHandle> vertexHandles;
+
+	// Task reading
+	typedef cgalmesher::Cgal2DMesher::TaskBody Body;
+	std::vector<Body> bodies;
+	for (const auto& b : task.bodies)
+		bodies.push_back({ b.id, b.r_w, b.well, b.outer, b.inner, b.constraint, b.fractures });
+
+	// Step refined towards the wells and fractures
+	cgalmesher::SizingFunction sizing;
+	if (task.minStep > 0.0 && task.stepGrowth > 0.0)
+	{
+		cgalmesher::GradedSizing graded;
+		graded.h_min = task.minStep;
+		graded.h_max = task.spatialStep;
+		graded.growth = task.stepGrowth;
+		for (const auto& b : task.bodies)
+		{
+			graded.wells.push_back(cgalmesher::CgalPoint2(b.well[0], b.well[1]));
+			for (const auto& con : b.constraint)
+				graded.segments.push_back({ cgalmesher::CgalPoint2(con.first[0], con.first[1]),
+											cgalmesher::CgalPoint2(con.second[0], con.second[1]) });
+			for (const auto& con : b.fractures)
+				graded.segments.push_back({ cgalmesher::CgalPoint2(con.first[0], con.first[1]),
+											cgalmesher::CgalPoint2(con.second[0], con.second[1]) });
+		}
+		graded.build();
+		sizing = graded;
+	}
+
+	// Triangulation sends addtional info about constraints
+	std::vector<size_t> constrainedCells;
+	cgalmesher::Cgal2DMesher::triangulate(task.spatialStep, bodies, triangulation, constrainedCells, sizing, task.incrementalMeshing);
+
+	// Cells / Vertices addition
+	std::set<VertexHandle> localVertices;
+	size_t cell_idx = 0;
+	inner_beg = 0;
+	for (auto cellIter = triangulation.finite_faces_begin(); cellIter != triangulation.finite_faces_end(); ++cellIter)
+	{
+		cellIter->info().id = cell_idx;
+		cells.push_back(TriangleCell(cell_idx++));
+		for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+			localVertices.insert(cellIter->vertex(i));
+
+		auto& cell = cells[cells.size() - 1];
+		cell.type = CellType::INNER;
+		const auto& tri = triangulation.triangle(cellIter);
+		cell.V = fabs(tri.area() * height);
+		Volume += cell.V;
+		const auto center = CGAL::barycenter(tri.vertex(0), 1.0 / 3.0, tri.vertex(1), 1.0 / 3.0, tri.vertex(2));
+		cell.c = { center[0], center[1] };
+	}
+	inner_cells = cells.size();
+
+	// Coping vertices from set to vector
+	vertexHandles.assign(localVertices.begin(), localVertices.end());
+	vertices.resize(vertexHandles.size());
+	for (size_t i = 0; i < vertexHandles.size(); i++)
+	{
+		vertexHandles[i]->info() = i;
+		const auto& pt = vertexHandles[i]->point();
+		vertices[i] = { pt[0], pt[1] };
+	}
+
+	// Border / Constrained cells treatment
+	int nebrCounter;
+	size_t vecCounter = 0;
+	auto cellIter = triangulation.finite_faces_begin();
+	cells.reserve(int(1.5  * inner_cells));
+	border_beg = cells.size();
+	for (int cell_idx = 0; cell_idx < inner_cells; cell_idx++)
+	{
+		TriangleCell& cell = cells[cell_idx];
+		nebrCounter = 0;
+
+		for (int i = 0; i < CELL_POINTS_NUMBER; i++)
+		{
+			cell.points[i] = cellIter->vertex(i)->info();
+			const auto& nebr = cellIter->neighbor(i);
+
+			cell.length[i] = sqrt(fabs(CGAL::squared_distance(cellIter->vertex(cellIter->cw(i))->point(), cellIter->vertex(cellIter->ccw(i))->point())));
+			const point::Point2d& pt1 = { cellIter->vertex(cellIter->cw(i))->point()[0], cellIter->vertex(cellIter->cw(i))->point()[1] };
+			const point::Point2d& pt2 = { cellIter->vertex(cellIter->ccw(i))->point()[0], cellIter->vertex(cellIter->ccw(i))->point()[1] };
+			cell.dist[i] = point::distance(cell.c, (pt1 + pt2) / 2.0);
+			if (!triangulation.is_infinite(nebr))
+			{
+				cell.nebr[i] = nebr->info().id;
+				nebrCounter++;
+			}
+			else
+			{
+				const point::Point2d& p1 = { cellIter->vertex(cellIter->cw(i))->point()[0], cellIter->vertex(cellIter->cw(i))->point()[1] };
+				const point::Point2d& p2 = { cellIter->vertex(cellIter->ccw(i))->point()[0], cellIter->vertex(cellIter->ccw(i))->point()[1] };
+				cells.push_back(TriangleCell(inner_cells + border_edges));
+				TriangleCell& edge = cells[cells.size() - 1];
+				edge.type = CellType::BORDER;
+				edge.c = (p1 + p2) / 2.0;
+				edge.V = point::distance(p1, p2);
+				edge.nebr[0] = cell_idx;
+				edge.points[0] = cellIter->vertex(cellIter->cw(i))->info();
+				edge.points[1] = cellIter->vertex(cellIter->ccw(i))->info();
+				cell.nebr[i] = inner_cells + border_edges;
+				border_edges++;
+			}
+		}
+		++cellIter;
+	}
+
+	setSymmetryBorder(task, data);
+	setConstrainedCells(task, height, data);
+
+	// Setting type to fracture cells
+	PolygonIndex fracIndex;
+	for (const auto& body : task.bodies)
+		fracIndex.addConstraints(body.constraint);
+	fracIndex.build();
+
+	for (size_t cell_idx = 0; cell_idx < inner_cells; cell_idx++)
+	{
+		auto& cell = cells[cell_idx];
+		if (fracIndex.locate({ cell.c.x, cell.c.y }) != PolygonIndex::LOCATION::OUTSIDE)
+		{
+			cell.type = CellType::FRAC;
+			fracCells.push_back(cell.id);
+		}
+	}
+
+	point::Point2d well_pt = { task.bodies[0].well[0], task.bodies[0].well[1] };
+
+	cells.push_back(TriangleCell(cells.size()));
+	well_idx = cells.size() - 1;
+	auto& well_cell = cells[cells.size() - 1];
+	well_cell.type = CellType::WELL;
+	well_cell.c = well_pt;
+	well_vol = 0.0;
+	wellModel = task.bodies[0].wellModel;
+	if (wellModel == WELL_MODEL::PEACEMAN)
+	{
+		setPerforations(task.bodies[0], height, data);
+		setFractureWell(task.bodies[0], data);
+		return;
+	}
+	for (const auto fcell_idx : fracCells)
+	{
+		auto& fcell = cells[fcell_idx];
+		const double dist = point::distance(well_pt, fcell.c);
+		if (dist < task.bodies[0].r_w)
+		{
+			fcell.type = CellType::WELL;
+			wellCells.push_back(fcell_idx);
+			well_vol += fcell.V;
+		}
+	}
+	cellIter = triangulation.finite_faces_begin();
+	for (size_t cell_idx = 0; cell_idx < inner_cells; cell_idx++)
+	{
+		auto& cell = cells[cell_idx];
+		if (cell.type == CellType::INNER || cell.type == CellType::FRAC)
+		{
+			for (size_t i = 0; i < CELL_POINTS_NUMBER; i++)
+				if (cells[cell.nebr[i]].type == CellType::WELL)
+				{
+					cell.nebr[i] = cells.size() - 1;
+					const point::Point2d& pt1 = { cellIter->vertex(cellIter->cw(i))->point()[0], cellIter->vertex(cellIter->cw(i))->point()[1] };
+					const point::Point2d& pt2 = { cellIter->vertex(cellIter->ccw(i))->point()[0], cellIter->vertex(cellIter->ccw(i))->point()[1] };
+					wellNebrs.push_back({ cell.id, cell.length[i], point::distance(well_cell.c, (pt1 + pt2) / 2.0) });
+				}
+		}
+		++cellIter;
+	}
+	setFractureWell(task.bodies[0], data);
+}
@@ -0,0 +1,35 @@
+#ifndef TRIANGLEMESHBUILDER_H_
+#define TRIANGLEMESHBUILDER_H_
+
+#include "src/mesh/MeshData.hpp"
+
+namespace mesh
+{
+	/**
+	* Builds the runtime mesh from the task by CGAL
+	* Triangulation lives only inside the build and is released after it
+	*/
+	class TriangleMeshBuilder
+	{
+	public:
+		/// Fills cells, vertices and well neighbours in the native CGAL order
+		/// Only the sector cut by the symmetry planes of the task is meshed
+		static void build(const Task& fullTask, const double height, MeshData& data);
+		/// Task clipped by the symmetry planes
+		static Task getSector(const Task& task);
+		/// Ratio of the full domain area to the sector one
+		static double getSymmetryFactor(const Task& task);
+	protected:
+		/// Moves border cells lying on the symmetry planes to the end of the border range
+		static void setSymmetryBorder(const Task& task, MeshData& data);
+		/// Creates 1D fracture cells on the edges lying on the fractures of the task
+		static void setConstrainedCells(const Task& task, const double height, MeshData& data);
+		/// Connects the PEACEMAN well to the cells containing the well point
+		static void setPerforations(const Task::Body& body, const double height, MeshData& data);
+		/// Connects 1D fracture cells to the well: the ones bordering the merged MESHED well cells
+		/// or passing within r_w of the PEACEMAN well, throws if the well is not connected to the mesh
+		static void setFractureWell(const Task::Body& body, MeshData& data);
+	};
+};
+
+#endif /* TRIANGLEMESHBUILDER_H_ */
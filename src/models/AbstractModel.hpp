@@ -39,6 +39,10 @@ protected:
 	// Rate of the well
 	double Q_sum;
 	double Pwf;
+	// Time step and well controls recorded on the tape
+	adouble tape_ht;
+	adouble tape_Q_sum;
+	adouble tape_Pwf;
 	// Ranges of perforated cells numbers
 	std::vector<std::pair<int,int> > perfIntervals;
 	// Vector of <cell number, rate in the cell> for left border cells
@@ -80,9 +84,12 @@ protected:
 	{
 		Qcell[mesh->well_idx] = 0.0;
 	};
+	// Static per-face data computed once the mesh is loaded
+	virtual void setTrans() {};
 	virtual void setInitialState() = 0;
 
-	adouble linearAppr(const adouble a1, const double r1, const adouble a2, const double r2)
+	template <typename T>
+	T linearAppr(const T& a1, const double r1, const T& a2, const double r2) const
 	{
 		return (a1 * r2 + a2 * r1) / (r1 + r2);
 	}
@@ -108,6 +115,10 @@ public:
 	{
 		setProps(props);
 		loadMesh(task, props.props_sk[0].height / props.R_dim);
+		setTrans();
+		// Rates are given for the full domain, only the symmetry sector is simulated
+		for (auto& q : rate)
+			q /= mesh->symmetryFactor;
 
 		u_prev.resize(varNum);
 		u_iter.resize(varNum);
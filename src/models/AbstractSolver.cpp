@@ -2,6 +2,12 @@
 #include "src/util/utils.h"
 #include <iomanip>
 #include <iterator>
+#include <fstream>
+#include <chrono>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "src/models/Oil2d/Oil2d.hpp"
 #include "src/models/Acid/Acid2d.hpp"
@@ -12,6 +18,19 @@ template <class modelType>
 AbstractSolver<modelType>::AbstractSolver(modelType* _model) : model(_model), mesh(_model->getMesh()), size(_model->cellsNum), Tt(model->period[model->period.size() - 1])
 {
 	NEWTON_STEP = 1.0;
+	MAX_ITER = 20;
+	// Models set the scales and residual tolerances of their variables
+	CONV_SCALE.fill(1.0);
+	CONV_DX.fill(1.e-4);
+	CONV_RES.fill(0.0);
+	CONV_AVER.fill(0.0);
+
+	INEXACT_NEWTON = true;
+	EW_GAMMA = 0.9;		EW_ALPHA = 2.0;
+	ETA_MIN = 1.e-12;	ETA_MAX = 0.9;
+	ETA_INIT = 1.e-1;
+	eta = ETA_INIT;
+	resNormPrev = 0.0;
 	cur_t = cur_t_log = 0.0;
 	curTimePeriod = 0;
 
@@ -19,11 +38,27 @@ AbstractSolver<modelType>::AbstractSolver(modelType* _model) : model(_model), me
 	//idx2 = idx1 + model->cellsNum_z + 1;
 
 	t_dim = model->t_dim;
-	repeat = 0;
+
+	KEEP_TAPE = false;
+	isTaped = false;
+
+	CACHE_SPARSITY = false;
+	colorsNum = 0;
+	seed = compressed = nullptr;
+
+#ifdef _OPENMP
+	THREADS_NUM = omp_get_max_threads();
+#else
+	THREADS_NUM = 1;
+#endif
 }
 template <class modelType>
 AbstractSolver<modelType>::~AbstractSolver()
 {
+	if (seed != nullptr)
+		myfree2(seed);
+	if (compressed != nullptr)
+		myfree2(compressed);
 }
 template <class modelType>
 void AbstractSolver<modelType>::start()
@@ -46,6 +81,34 @@ void AbstractSolver<modelType>::start()
 	writeData();
 }
 template <class modelType>
+void AbstractSolver<modelType>::benchmarkAssembly(const int repeats)
+{
+	fillIndices();
+
+	const int maxThreads = THREADS_NUM;
+	double serialTime = 0.0;
+	cout << "Threads\tTime per assembly [s]\tSpeedup" << endl;
+	for (int threads = 1; ; threads = std::min(2 * threads, maxThreads))
+	{
+		THREADS_NUM = threads;
+		computeJacDual();
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < repeats; i++)
+			computeJacDual();
+		const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+		const double time = elapsed.count() / repeats;
+		if (threads == 1)
+			serialTime = time;
+		cout << threads << "\t" << setprecision(6) << time << "\t" << serialTime / time << endl;
+
+		if (threads == maxThreads)
+			break;
+	}
+	THREADS_NUM = maxThreads;
+}
+template <class modelType>
 void AbstractSolver<modelType>::doNextStep()
 {
 	solveStep();
@@ -55,59 +118,313 @@ void AbstractSolver<modelType>::fill()
 {
 }
 template <class modelType>
-void AbstractSolver<modelType>::copyIterLayer()
+void AbstractSolver<modelType>::fillIndices()
+{
+	// Pattern depends only on the mesh, so it is built once per solver
+	if (!rowPtr.empty())
+		return;
+
+	const int n = var_size * model->cellsNum;
+
+	std::vector<int> cols;
+	const std::string fileName = getSparsityFileName();
+	if (!CACHE_SPARSITY || !loadSparsity(fileName, cols))
+	{
+		buildSparsity(cols);
+		if (CACHE_SPARSITY)
+			saveSparsity(fileName, cols);
+	}
+
+	elemNum = cols.size();
+	delete[] ind_i;
+	delete[] ind_j;
+	delete[] a;
+	ind_i = new int[elemNum];
+	ind_j = new int[elemNum];
+	a = new double[elemNum];
+	for (int row = 0; row < n; row++)
+		for (int k = rowPtr[row]; k < rowPtr[row + 1]; k++)
+		{
+			ind_i[k] = row;
+			ind_j[k] = cols[k];
+		}
+
+	// Seed matrix compresses all columns of the same color into one
+	if (seed != nullptr)
+		myfree2(seed);
+	if (compressed != nullptr)
+		myfree2(compressed);
+	seed = myalloc2(n, colorsNum);
+	compressed = myalloc2(n, colorsNum);
+	for (int j = 0; j < n; j++)
+		for (int c = 0; c < colorsNum; c++)
+			seed[j][c] = (colors[j] == c) ? 1.0 : 0.0;
+
+	for (int i = 0; i < n; i++)
+		ind_rhs[i] = i;
+}
+template <class modelType>
+void AbstractSolver<modelType>::buildSparsity(std::vector<int>& cols)
+{
+	const size_t cellsNum = model->cellsNum;
+
+	std::vector<std::vector<int>> stencils(cellsNum);
+	for (const auto& cell : mesh->cells)
+	{
+		getMatrixStencil(cell);
+		std::sort(stencil_idx.begin(), stencil_idx.end());
+		stencil_idx.erase(std::unique(stencil_idx.begin(), stencil_idx.end()), stencil_idx.end());
+		stencils[cell.id] = stencil_idx;
+	}
+	stencil_idx.clear();
+
+	// Dense var_size x var_size blocks for each pair of connected cells
+	rowPtr.assign(1, 0);
+	cols.clear();
+	for (size_t cell_idx = 0; cell_idx < cellsNum; cell_idx++)
+		for (int i = 0; i < var_size; i++)
+		{
+			for (const int idx : stencils[cell_idx])
+				for (int j = 0; j < var_size; j++)
+					cols.push_back(var_size * idx + j);
+			rowPtr.push_back(cols.size());
+		}
+
+	// Greedy coloring of cells, cells met in the same stencil get different colors
+	std::vector<std::vector<int>> cellRows(cellsNum);
+	for (size_t row = 0; row < cellsNum; row++)
+		for (const int idx : stencils[row])
+			cellRows[idx].push_back(row);
+
+	std::vector<int> cellColors(cellsNum, -1);
+	std::vector<size_t> forbidden;
+	int cellColorsNum = 0;
+	for (size_t cell_idx = 0; cell_idx < cellsNum; cell_idx++)
+	{
+		for (const int row : cellRows[cell_idx])
+			for (const int idx : stencils[row])
+				if (cellColors[idx] >= 0)
+					forbidden[cellColors[idx]] = cell_idx;
+
+		int color = 0;
+		while (color < cellColorsNum && forbidden[color] == cell_idx)
+			color++;
+		if (color == cellColorsNum)
+		{
+			forbidden.push_back(cellsNum);
+			cellColorsNum++;
+		}
+		cellColors[cell_idx] = color;
+	}
+
+	colorsNum = var_size * cellColorsNum;
+	colors.resize(var_size * cellsNum);
+	for (size_t cell_idx = 0; cell_idx < cellsNum; cell_idx++)
+		for (int j = 0; j < var_size; j++)
+			colors[var_size * cell_idx + j] = var_size * cellColors[cell_idx] + j;
+}
+template <class modelType>
+std::string AbstractSolver<modelType>::getSparsityFileName() const
+{
+	return "snaps/sparsity_" + std::to_string(var_size) + "_" + std::to_string(mesh->getHash()) + ".bin";
+}
+template <class modelType>
+bool AbstractSolver<modelType>::loadSparsity(const std::string& fileName, std::vector<int>& cols)
 {
-	model->u_iter = model->u_next;
+	ifstream file(fileName, ifstream::binary);
+	if (!file.is_open())
+		return false;
+
+	// var_size, number of rows, number of non-zero elements, number of colors
+	int header[4];
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	const int n = var_size * model->cellsNum;
+	if (!file || header[0] != var_size || header[1] != n)
+		return false;
+
+	rowPtr.resize(n + 1);
+	cols.resize(header[2]);
+	colors.resize(n);
+	colorsNum = header[3];
+	file.read(reinterpret_cast<char*>(&rowPtr[0]), rowPtr.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(&cols[0]), cols.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(&colors[0]), colors.size() * sizeof(int));
+
+	return !file.fail() && rowPtr[n] == header[2];
+}
+template <class modelType>
+void AbstractSolver<modelType>::saveSparsity(const std::string& fileName, const std::vector<int>& cols) const
+{
+	ofstream file(fileName, ofstream::binary);
+	if (!file.is_open())
+		return;
+
+	const int header[4] = { var_size, static_cast<int>(rowPtr.size()) - 1, static_cast<int>(cols.size()), colorsNum };
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&rowPtr[0]), rowPtr.size() * sizeof(int));
+	file.write(reinterpret_cast<const char*>(&cols[0]), cols.size() * sizeof(int));
+	file.write(reinterpret_cast<const char*>(&colors[0]), colors.size() * sizeof(int));
+}
+template <class modelType>
+void AbstractSolver<modelType>::computeSparseJac()
+{
+	const int n = var_size * model->cellsNum;
+	if (fov_forward(0, n, n, colorsNum, &model->u_next[0], seed, y, compressed) < 0)
+	{
+		// Taped branches differ at the current point, the tape is recorded again
+		isTaped = false;
+		computeJac();
+		fov_forward(0, n, n, colorsNum, &model->u_next[0], seed, y, compressed);
+	}
+
+	for (int k = 0; k < elemNum; k++)
+		a[k] = compressed[ind_i[k]][colors[ind_j[k]]];
+}
+template <class modelType>
+void AbstractSolver<modelType>::swapIterLayer()
+{
+	model->u_iter.swap(model->u_next);
 }
 template <class modelType>
 void AbstractSolver<modelType>::revertIterLayer()
 {
-	model->u_next = model->u_iter;
+	model->u_next.swap(model->u_iter);
 }
 template <class modelType>
 void AbstractSolver<modelType>::copyTimeLayer()
 {
-	model->u_prev = model->u_iter = model->u_next;
+	// u_next stays as the initial guess of the next step, u_iter is overwritten by the first update
+	model->u_prev = model->u_next;
 }
 
 template <class modelType>
-double AbstractSolver<modelType>::convergance(int& ind, int& varInd)
+void AbstractSolver<modelType>::resetConvergence()
 {
-	double relErr = 0.0;
-	double cur_relErr = 0.0;
+	const auto& next = model->u_next;
+	conv.aver.fill(0.0);
+	for (size_t i = 0; i < size; i++)
+	{
+		const double V = mesh->cells[i].V;
+		for (int v = 0; v < var_size; v++)
+			conv.aver[v] += next[var_size * i + v] * V;
+	}
+	for (auto& val : conv.aver)
+		val /= mesh->Volume;
 
-	varInd = 0;
-	auto diff = std::abs((model->u_next - model->u_iter) / model->u_next);
-	auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-	ind = std::distance(std::begin(diff), max_iter);
-			
-	return *max_iter;
+	conv.dx.fill(std::numeric_limits<double>::max());
+	conv.res.fill(std::numeric_limits<double>::max());
+	conv.dAver.fill(std::numeric_limits<double>::max());
+	conv.cell = conv.var = 0;
+	conv.isLoose = false;
 }
 template <class modelType>
-double AbstractSolver<modelType>::averValue(const int varInd)
+void AbstractSolver<modelType>::updateConvergence()
 {
-	double tmp = 0.0;
-	for (size_t i = 0; i < model->cellsNum; i++)
+	const auto& next = model->u_next;
+	const auto& iter = model->u_iter;
+	std::array<double, var_size> aver;
+	aver.fill(0.0);
+	conv.dx.fill(0.0);
+	conv.res.fill(0.0);
+
+	double worst = -1.0;
+	for (size_t i = 0; i < size; i++)
+	{
+		const double V = mesh->cells[i].V;
+		for (int v = 0; v < var_size; v++)
+		{
+			const size_t k = var_size * i + v;
+			// Scale is floored, so zero concentrations do not blow the relative update up
+			const double scale = std::max(CONV_SCALE[v], std::max(fabs(next[k]), fabs(iter[k])));
+			const double dx = fabs(next[k] - iter[k]) / scale;
+			conv.dx[v] = std::max(conv.dx[v], dx);
+			if (dx > worst * CONV_DX[v])
+			{
+				worst = dx / CONV_DX[v];
+				conv.cell = i;
+				conv.var = v;
+			}
+			conv.res[v] = std::max(conv.res[v], fabs(y[k]));
+			aver[v] += next[k] * V;
+		}
+	}
+	for (int v = 0; v < var_size; v++)
 	{
-		auto cell = (*model)[i];
-		tmp += cell.u_next.p * mesh->cells[i].V;
+		aver[v] /= mesh->Volume;
+		conv.dAver[v] = fabs(aver[v] - conv.aver[v]);
+		conv.aver[v] = aver[v];
 	}
-	return tmp / mesh->Volume;
 }
 template <class modelType>
-void AbstractSolver<modelType>::averValue(std::array<double, var_size>& aver)
+bool AbstractSolver<modelType>::isConverged() const
 {
-	std::fill(aver.begin(), aver.end(), 0.0);
+	bool isResidualSmall = true, isStalled = true;
+	for (int v = 0; v < var_size; v++)
+	{
+		isResidualSmall &= (conv.res[v] <= CONV_RES[v]);
+		isStalled &= (conv.dAver[v] <= CONV_AVER[v]);
+	}
+	return (isUpdateSmall() && !conv.isLoose) || isResidualSmall || isStalled;
+}
+template <class modelType>
+bool AbstractSolver<modelType>::isUpdateSmall() const
+{
+	for (int v = 0; v < var_size; v++)
+		if (conv.dx[v] > CONV_DX[v])
+			return false;
+	return true;
+}
+
+template <class modelType>
+void AbstractSolver<modelType>::printConvergence() const
+{
+	cout << "Newton Iterations = " << iterations << ", largest update of variable " << conv.var << " in cell " << conv.cell <<
+		": " << conv.dx[conv.var] << " (tolerance " << CONV_DX[conv.var] << ")" << endl;
+}
+template <class modelType>
+double AbstractSolver<modelType>::getResidualNorm() const
+{
+	double norm = 0.0;
+	for (size_t i = 0; i < var_size * size; i++)
+		norm += y[i] * y[i];
+	return sqrt(norm);
+}
+template <class modelType>
+void AbstractSolver<modelType>::resetForcingTerm()
+{
+	eta = ETA_INIT;
+	resNormPrev = 0.0;
+}
+template <class modelType>
+double AbstractSolver<modelType>::getForcingTerm()
+{
+	if (!INEXACT_NEWTON)
+		return 0.0;
 
-	for (int i = 0; i < var_size; i++)
+	const double resNorm = getResidualNorm();
+	if (resNormPrev > 0.0)
 	{
-		const auto var = static_cast<std::valarray<double>>(model->u_next[std::slice(i, model->cellsNum, var_size)]);
-		int cell_idx = 0;
-		for (const auto& cell : mesh->cells)
-			aver[i] += var[cell_idx++] * cell.V;
+		// Safeguard keeps eta from dropping too fast after a single good iteration
+		// while the previous eta is still large
+		const double safeguard = EW_GAMMA * pow(eta, EW_ALPHA);
+		eta = EW_GAMMA * pow(resNorm / resNormPrev, EW_ALPHA);
+		if (safeguard > 0.1)
+			eta = std::max(eta, safeguard);
+		eta = std::min(ETA_MAX, std::max(ETA_MIN, eta));
 	}
-	for(auto& val : aver)
-		val /= mesh->Volume;
+	else
+		eta = ETA_INIT;
+	resNormPrev = resNorm;
+
+	// Update of the loose solve may be small as the linear solver stopped early,
+	// so it is accepted only after the tight solve at the new residual
+	if (conv.isLoose && isUpdateSmall())
+	{
+		conv.isLoose = false;
+		return 0.0;
+	}
+	conv.isLoose = true;
+	return eta;
 }
 
 template <class modelType>
@@ -6,6 +6,12 @@
 #include <iostream>
 #include <array>
 #include <vector>
+#include <string>
+
+#include "adolc/adolc.h"
+
+enum class JAC_ENGINE {ADOLC, ANALYTIC, DUAL};
+enum class LIN_SOLVER {PARALUTION, BLOCK};
 
 template <class modelType>
 class AbstractSolver {
@@ -32,13 +38,53 @@ protected:
 
 	int iterations;
 		
-	void copyIterLayer();
+	// Time layers are rotated by swapping the buffers of the valarrays,
+	// the Newton update is written to u_iter and becomes u_next by the swap
+	void swapIterLayer();
 	void revertIterLayer();
 	void copyTimeLayer();
 		
-	double convergance(int& ind, int& varInd);
-	double averValue(int varInd);
-	void averValue(std::array<double, var_size>& aver);
+	// Newton convergence measures gathered in one pass over the state
+	struct Convergence
+	{
+		// Max over cells of |u_next - u_iter| / max(|u_next|, |u_iter|, CONV_SCALE) per variable
+		std::array<double, var_size> dx;
+		// Max norm of the residual per variable held in y, at the last linearization point
+		// or at the accepted point if the residual is evaluated by the line search
+		std::array<double, var_size> res;
+		// Volume-weighted averages per variable and their change over the last iteration
+		std::array<double, var_size> aver, dAver;
+		// Cell and variable of the largest update relative to its tolerance
+		int cell, var;
+		// Update is given by the linear solve with the loose forcing term
+		bool isLoose;
+	};
+	Convergence conv;
+	// Averages of the initial guess, called before the first iteration of the step
+	void resetConvergence();
+	// Called after the Newton update, residual is taken from y
+	void updateConvergence();
+	// True if all the updates, all the residuals or all the averages are within their tolerances,
+	// small update of the loose linear solve is not accepted
+	bool isConverged() const;
+	bool isUpdateSmall() const;
+	// 2-norm of the residual in y
+	double getResidualNorm() const;
+	// Number of iterations and the largest update relative to its tolerance
+	void printConvergence() const;
+
+	// Inexact Newton, relative tolerance of the linear solver follows the reduction of the residual norm
+	// by Eisenstat-Walker: eta = EW_GAMMA * (|F_k| / |F_k-1|)^EW_ALPHA bounded by [ETA_MIN, ETA_MAX],
+	// the first iteration of the step is solved with ETA_INIT
+	bool INEXACT_NEWTON;
+	double EW_GAMMA, EW_ALPHA, ETA_MIN, ETA_MAX, ETA_INIT;
+	double eta, resNormPrev;
+	// Called before the first iteration of the step
+	void resetForcingTerm();
+	// Tolerance for the system linearized at the current iterate, y holds its residual
+	// Zero means the tolerances of the linear solver itself, it is also returned
+	// after the small update of the loose solve to confirm it at the new residual
+	double getForcingTerm();
 		
 	virtual void writeData() = 0;
 	virtual void control() = 0;
@@ -47,7 +93,8 @@ protected:
 	double NEWTON_STEP;
 	double CHOP_MULT;
 	double MAX_SAT_CHANGE;
-	double CONV_W2, CONV_VAR;
+	// Per-variable floors of the update scale and tolerances on the update, residual and change of averages
+	std::array<double, var_size> CONV_SCALE, CONV_DX, CONV_RES, CONV_AVER;
 	int MAX_ITER;
 
 	virtual void checkStability();
@@ -61,6 +108,20 @@ protected:
 			stencil_idx[0] = cell.id;
 			stencil_idx[1] = cell.nebr[0];
 		}
+		else if (cell.id == mesh->well_idx)
+		{
+			stencil_idx.resize(1);
+			stencil_idx[0] = cell.id;
+			for (const auto& nebr : mesh->wellNebrs)
+				stencil_idx.push_back(nebr.id);
+		}
+		else if (cell.type == CellType::CONSTRAINED)
+		{
+			stencil_idx.resize(1);
+			stencil_idx[0] = cell.id;
+			for (int i = 0; i < mesh->getNebrsNum(cell); i++)
+				stencil_idx.push_back(mesh->getNebr(cell, i));
+		}
 		else
 		{
 			stencil_idx.resize(4);
@@ -68,6 +129,10 @@ protected:
 			stencil_idx[1] = cell.nebr[0];
 			stencil_idx[2] = cell.nebr[1];
 			stencil_idx[3] = cell.nebr[2];
+			// Cells merged into the well are tied to the well pressure,
+			// perforated cells are connected to the well by the well index
+			if (cell.type == CellType::WELL || mesh->getPerfIdx(cell.id) >= 0)
+				stencil_idx.push_back(mesh->well_idx);
 		}
 	};
 
@@ -80,34 +145,82 @@ protected:
 	// Number of non-zero elements in sparse matrix
 	int elemNum;
 
-	int options[4];
-	int repeat;
+	// Sparsity pattern of the Jacobian built from the mesh connectivity
+	// CSR offsets of rows in ind_i / ind_j
+	std::vector<int> rowPtr;
+	// Column coloring, columns of the same color do not share any row
+	std::vector<int> colors;
+	int colorsNum;
+	double** seed;
+	double** compressed;
+	// If true the pattern is saved to disk and reused on the same mesh
+	bool CACHE_SPARSITY;
+	void buildSparsity(std::vector<int>& cols);
+	std::string getSparsityFileName() const;
+	bool loadSparsity(const std::string& fileName, std::vector<int>& cols);
+	void saveSparsity(const std::string& fileName, const std::vector<int>& cols) const;
+	void computeSparseJac();
+	// Position of (row, col) element in ind_i / ind_j, columns inside the row are sorted
+	inline int getElemIdx(const int row, const int col) const
+	{
+		return std::lower_bound(ind_j + rowPtr[row], ind_j + rowPtr[row + 1], col) - ind_j;
+	};
+	// Fills the residual and the Jacobian rows of the cell from the kernel evaluated in dual numbers
+	// Stencil is taken from the CSR row, so rows of different cells may be filled concurrently
+	// Stencils wider than the dual number are seeded by chunks
+	template <class TState, class TKernel>
+	inline void assembleDualRow(const Cell& cell, TState& st, const TKernel& kernel)
+	{
+		const int cellsMax = TState::cellsMax;
+		const int first = rowPtr[var_size * cell.id];
+		const int cellsNum = (rowPtr[var_size * cell.id + 1] - first) / var_size;
+		int ids[cellsMax];
+		for (int beg = 0; beg < cellsNum; beg += cellsMax)
+		{
+			const int num = std::min(cellsMax, cellsNum - beg);
+			for (int k = 0; k < num; k++)
+				ids[k] = ind_j[first + var_size * (beg + k)] / var_size;
+			st.seed(ids, num);
+
+			const typename TState::Variable res = kernel(st);
+			for (int i = 0; i < var_size; i++)
+			{
+				const int row = var_size * cell.id + i;
+				double* row_a = a + rowPtr[row] + var_size * beg;
+				y[row] = res[i].val;
+				for (int k = 0; k < var_size * num; k++)
+					row_a[k] = res[i].dx[k];
+			}
+		}
+	};
+
+	// Number of threads used in the assembly
+	int THREADS_NUM;
+	// Records the residual on the ADOL-C tape or re-evaluates the kept one
+	virtual void computeJac() = 0;
+	virtual void computeJacDual() = 0;
+
+	// If true the tape is recorded once and re-evaluated with new parameters
+	bool KEEP_TAPE;
+	bool isTaped;
+	// Values of the tape parameters in the order of their recording
+	std::vector<double> tapeParams;
+	inline void setTapeParam(adouble& var, const double value) const
+	{
+		if (KEEP_TAPE)
+			var = mkparam(value);
+		else
+			var = value;
+	};
 public:
 	AbstractSolver(modelType* _model);
 	virtual ~AbstractSolver();
 		
 	virtual void fill();
-	void fillIndices()
-	{
-		int counter = 0;
-
-		/*for (const auto& cell : mesh->cells)
-		{
-			getMatrixStencil(cell);
-			for (size_t i = 0; i < var_size; i++)
-				for (const int idx : stencil_idx)
-					for (size_t j = 0; j < var_size; j++)
-					{
-						ind_i[counter] = var_size * cell.id + i;			ind_j[counter++] = var_size * idx + j;
-					}
-			stencil_idx.clear();
-		}
-
-		elemNum = counter;*/
-		for (int i = 0; i < var_size * model->cellsNum; i++)
-			ind_rhs[i] = i;
-	}
+	void fillIndices();
 	virtual void start();
+	// Times the dual assembly for the growing number of threads
+	void benchmarkAssembly(const int repeats = 10);
 };
 
 #endif /* ABSTRACTSOLVER_HPP_ */
@@ -16,6 +16,7 @@ Acid2d::Acid2d()
 Acid2d::~Acid2d()
 {
 	delete[] x, h;
+	delete[] x_prev;
 }
 void Acid2d::setProps(const Properties& props)
 {
@@ -139,6 +140,16 @@ void Acid2d::setPeriod(int period)
 
 	xa = xas[period];
 }
+void Acid2d::setTrans()
+{
+	faceGeom.resize(mesh->faces.size());
+	for (size_t i = 0; i < mesh->faces.size(); i++)
+	{
+		const auto& face = mesh->faces[i];
+		const double mult = 1.0 / (props_sk[0].height * face.length);
+		faceGeom[i] = { face.dist1 * mult, face.dist2 * mult };
+	}
+}
 void Acid2d::setInitialState()
 {
 	const auto& props = props_sk[0];
@@ -147,7 +158,7 @@ void Acid2d::setInitialState()
 		const auto& cell = mesh->cells[i];
 		auto data = (*this)[i];
 
-		if (cell.type == CellType::FRAC || cell.type == CellType::WELL)
+		if (cell.type == CellType::FRAC || cell.type == CellType::WELL || cell.type == CellType::CONSTRAINED)
 		{
 			data.u_prev.p = data.u_iter.p = data.u_next.p = props.p_init;
 			data.u_prev.m = data.u_iter.m = data.u_next.m = 0.6;
@@ -163,6 +174,7 @@ void Acid2d::setInitialState()
 	}
 
 	x = new TapeVariable[cellsNum];
+	x_prev = new TapeVariable[cellsNum];
 	h = new adouble[var_size * cellsNum];
 }
 double Acid2d::getRate(const size_t cur)
@@ -170,49 +182,53 @@ double Acid2d::getRate(const size_t cur)
 	return 0.0;
 };
 
-TapeVariable Acid2d::solveInner(const Cell& cell)
+template <class TState>
+typename TState::Variable Acid2d::solveInner(const Cell& cell, const TState& st) const
 {
-	const auto& cur = x[cell.id];
-	const auto prev = (*this)[cell.id].u_prev;
+	typedef typename TState::Scalar Scalar;
+	typedef typename TState::Variable Variable;
+	const auto& cur = st[cell.id];
+	const auto& prev = st.prev(cell.id);
 	const auto& props = props_sk[0];
 
-	adouble rate = getReactionRate(cell, props);
-	TapeVariable res;
+	const Scalar rate = getReactionRate(cur, props);
+	Variable res;
 	res.m = (1.0 - cur.m) * props.getDensity(cur.p) - (1.0 - prev.m) * props.getDensity(prev.p) -
-		ht * reac.indices[REACTS::CALCITE] * reac.comps[REACTS::CALCITE].mol_weight * rate;
+		st.ht * reac.indices[REACTS::CALCITE] * reac.comps[REACTS::CALCITE].mol_weight * rate;
 	res.p = cur.m * cur.s * props_w.getDensity(cur.p, cur.xa, cur.xw) -
 		prev.m * prev.s * props_w.getDensity(prev.p, prev.xa, prev.xw) -
-		ht * (reac.indices[REACTS::ACID] * reac.comps[REACTS::ACID].mol_weight +
+		st.ht * (reac.indices[REACTS::ACID] * reac.comps[REACTS::ACID].mol_weight +
 			reac.indices[REACTS::WATER] * reac.comps[REACTS::WATER].mol_weight +
 			reac.indices[REACTS::SALT] * reac.comps[REACTS::SALT].mol_weight) * rate;
 	res.s = cur.m * (1.0 - cur.s) * props_o.getDensity(cur.p) -
 		prev.m * (1.0 - prev.s) * props_o.getDensity(prev.p);
-	double qwe = (*this)[cell.id].u_next.m * (*this)[cell.id].u_next.s * props_w.getDensity(cur.p, cur.xa, cur.xw).value();
 	res.xa = cur.m * cur.s * props_w.getDensity(cur.p, cur.xa, cur.xw) * cur.xa -
 		prev.m * prev.s * props_w.getDensity(prev.p, prev.xa, prev.xw) * prev.xa -
-		ht * reac.indices[REACTS::ACID] * reac.comps[REACTS::ACID].mol_weight * rate;
+		st.ht * reac.indices[REACTS::ACID] * reac.comps[REACTS::ACID].mol_weight * rate;
 	res.xw = cur.m * cur.s * props_w.getDensity(cur.p, cur.xa, cur.xw) * cur.xw -
 		prev.m * prev.s * props_w.getDensity(prev.p, prev.xa, prev.xw) * prev.xw -
-		ht * reac.indices[REACTS::WATER] * reac.comps[REACTS::WATER].mol_weight * rate;
+		st.ht * reac.indices[REACTS::WATER] * reac.comps[REACTS::WATER].mol_weight * rate;
 
-	for (size_t i = 0; i < 3; i++)
+	const Scalar mob_w = props_w.getDensity(cur.p, cur.xa, cur.xw) / props_w.getViscosity(cur.p, cur.xa, cur.xw);
+	const Scalar mob_o = props_o.getDensity(cur.p) / props_o.getViscosity(cur.p);
+	for (int i = 0; i < mesh->getNebrsNum(cell); i++)
 	{
-		const size_t nebr_idx = cell.nebr[i];
+		const size_t nebr_idx = mesh->getNebr(cell, i);
 		const auto& beta = mesh->cells[nebr_idx];
-		const auto& nebr = x[nebr_idx];
-		const size_t upwd_idx = getUpwindIdx(cell.id, beta.id);
-		TapeVariable& upwd = x[upwd_idx];
-
-		adouble dens_w = linearAppr(props_w.getDensity(cur.p, cur.xa, cur.xw) / props_w.getViscosity(cur.p, cur.xa, cur.xw), 
-									cell.dist[i],
-									props_w.getDensity(nebr.p, nebr.xa, nebr.xw) / props_w.getViscosity(nebr.p, nebr.xa, nebr.xw), 
-									beta.getDistance(cell.id));
-		adouble dens_o = linearAppr(props_o.getDensity(cur.p) / props_o.getViscosity(cur.p), cell.dist[i],
-									props_o.getDensity(nebr.p) / props_o.getViscosity(nebr.p), beta.getDistance(cell.id));
-		adouble buf_w = ht / cell.V * getTrans(cell, i, beta) * (cur.p - nebr.p) *
-			dens_w * props_w.getKr(upwd.s, props);
-		adouble buf_o = ht / cell.V * getTrans(cell, i, beta) * (cur.p - nebr.p) *
-			dens_o * props_o.getKr(upwd.s, props);
+		const auto& nebr = st[nebr_idx];
+		Variable upwd;
+		getUpwind(cur, nebr, upwd);
+
+		const auto& face = mesh->getFace(cell, i);
+		const double dist = face.getDistance(cell.id), dist_nebr = face.getDistance(beta.id);
+
+		const Scalar mob_w_nebr = props_w.getDensity(nebr.p, nebr.xa, nebr.xw) / props_w.getViscosity(nebr.p, nebr.xa, nebr.xw);
+		const Scalar mob_o_nebr = props_o.getDensity(nebr.p) / props_o.getViscosity(nebr.p);
+		const Scalar dens_w = linearAppr(mob_w, dist, mob_w_nebr, dist_nebr);
+		const Scalar dens_o = linearAppr(mob_o, dist, mob_o_nebr, dist_nebr);
+		const Scalar flux = st.ht / cell.V * getTrans(cell, i, beta, cur.m, nebr.m) * (cur.p - nebr.p);
+		const Scalar buf_w = flux * dens_w * props_w.getKr(upwd.s, props);
+		const Scalar buf_o = flux * dens_o * props_o.getKr(upwd.s, props);
 
 		res.p += buf_w;
 		res.s += buf_o;
@@ -221,20 +237,69 @@ TapeVariable Acid2d::solveInner(const Cell& cell)
 	}
 	return res;
 }
-TapeVariable Acid2d::solveBorder(const Cell& cell)
+template <class TState>
+typename TState::Variable Acid2d::solveBorder(const Cell& cell, const TState& st) const
 {
-	const auto& cur = x[cell.id];
-	const auto& nebr = x[cell.nebr[0]];
-	TapeVariable res;
-	adouble rightIsPres = rightBoundIsPres;
+	const auto& cur = st[cell.id];
+	const auto& nebr = st[cell.nebr[0]];
+	typename TState::Variable res;
 
 	res.m = (cur.m - nebr.m) / P_dim;
-	condassign(res.p, rightIsPres, (cur.p - (adouble)(props_sk[0].p_out)) / P_dim, (cur.p - (adouble)(nebr.p)) / P_dim);
+	// Symmetry lines are no-flow boundaries
+	if (rightBoundIsPres && !mesh->isSymmetry(cell.id))
+		res.p = (cur.p - props_sk[0].p_out) / P_dim;
+	else
+		res.p = (cur.p - nebr.p) / P_dim;
 	res.s = (cur.s - nebr.s) / P_dim;
 	res.xa = (cur.xa - nebr.xa) / P_dim;
 	res.xw = (cur.xw - nebr.xw) / P_dim;
 	return res;
 }
+template <class TState>
+typename TState::Variable Acid2d::solveWell(const Cell& cell, const TState& st) const
+{
+	typedef typename TState::Scalar Scalar;
+	typedef typename TState::Variable Variable;
+	const auto& cur = st[cell.id];
+	const auto& prev = st.prev(cell.id);
+	const auto& props = props_sk[0];
+	Variable res;
+
+	res.m = (cur.m - prev.m) / P_dim;
+	// PEACEMAN wellbore has no pore volume
+	if (mesh->wellModel == WELL_MODEL::MESHED)
+		res.p = cur.m * cur.s * props_w.getDensity(cur.p, cur.xa, cur.xw) -
+			prev.m * prev.s * props_w.getDensity(prev.p, prev.xa, prev.xw);
+	else
+		res.p = 0.0;
+	const Scalar mob_w = props_w.getDensity(cur.p, cur.xa, cur.xw) / props_w.getViscosity(cur.p, cur.xa, cur.xw);
+	for (size_t i = 0; i < mesh->wellNebrs.size(); i++)
+	{
+		const auto& nebr_str = mesh->wellNebrs[i];
+		const auto& beta = mesh->cells[nebr_str.id];
+		const auto& nebr = st[nebr_str.id];
+		Variable upwd;
+		getUpwind(cur, nebr, upwd);
+
+		const Scalar mob_w_nebr = props_w.getDensity(nebr.p, nebr.xa, nebr.xw) / props_w.getViscosity(nebr.p, nebr.xa, nebr.xw);
+		const auto& face = mesh->getFace(cell, i);
+		const Scalar dens_w = linearAppr(mob_w, face.getDistance(cell.id), mob_w_nebr, face.getDistance(beta.id));
+		res.p += st.ht / mesh->well_vol * getTrans(cell, i, beta, cur.m, nebr.m) * (cur.p - nebr.p) *
+			dens_w * props_w.getKr(upwd.s, props);
+	}
+	// Saturation and concentrations are set by the well controls
+	res.s = res.xa = res.xw = 0.0;
+	return res;
+}
+template TapeState::Variable Acid2d::solveInner<TapeState>(const Cell& cell, const TapeState& st) const;
+template ValueState::Variable Acid2d::solveInner<ValueState>(const Cell& cell, const ValueState& st) const;
+template DualState::Variable Acid2d::solveInner<DualState>(const Cell& cell, const DualState& st) const;
+template TapeState::Variable Acid2d::solveBorder<TapeState>(const Cell& cell, const TapeState& st) const;
+template ValueState::Variable Acid2d::solveBorder<ValueState>(const Cell& cell, const ValueState& st) const;
+template DualState::Variable Acid2d::solveBorder<DualState>(const Cell& cell, const DualState& st) const;
+template TapeState::Variable Acid2d::solveWell<TapeState>(const Cell& cell, const TapeState& st) const;
+template ValueState::Variable Acid2d::solveWell<ValueState>(const Cell& cell, const ValueState& st) const;
+template DualState::Variable Acid2d::solveWell<DualState>(const Cell& cell, const DualState& st) const;
 
 /*void Acid2d::solve_eqLeft(const Cell& cell)
 {
@@ -13,6 +13,9 @@ namespace acid2d
 	typedef CalciteReaction CurrentReaction;
 	typedef CurrentReaction::REACTS REACTS;
 	typedef var::containers::TapeAcidVar TapeVariable;
+	typedef var::TapeState<TapeVariable> TapeState;
+	typedef var::ValueState<var::containers::ScalarAcidVar> ValueState;
+	typedef var::DualState<var::containers::ScalarAcidVar, mesh::stencil * TapeVariable::size> DualState;
 
 	class Acid2d : public AbstractModel<var::containers::AcidVar, Properties, var::BasicVariables, Acid2d>
 	{
@@ -25,9 +28,11 @@ namespace acid2d
 		std::vector<Skeleton_Props> props_sk;
 
 		TapeVariable* x;
+		TapeVariable* x_prev;
 		adouble* h;
 
 		double xa;
+		adouble tape_xa;
 		std::vector<double> xas;
 
 		void setProps(const Properties& props);
@@ -35,44 +40,57 @@ namespace acid2d
 		void setInitialState();
 
 		// Service functions
-		inline const size_t getUpwindIdx(size_t cur, size_t beta) const
+		template <class TVar>
+		inline void getUpwind(const TVar& cur, const TVar& beta, TVar& upwd) const
 		{
-			if ((*this)[cur].u_next.p < (*this)[beta].u_next.p)
-				return beta;
-			else
-				return cur;
+			// Branchless to keep the tape valid when the flow direction changes
+			const typename TVar::Scalar isBetaUpwind = beta.p - cur.p;
+			condassign(upwd.s, isBetaUpwind, beta.s, cur.s);
+			condassign(upwd.xa, isBetaUpwind, beta.xa, cur.xa);
+			condassign(upwd.xw, isBetaUpwind, beta.xw, cur.xw);
 		};
-		inline adouble getReactionRate(const Cell& cell, const Skeleton_Props& props) const
+		template <class TVar>
+		inline typename TVar::Scalar getReactionRate(const TVar& var, const Skeleton_Props& props) const
 		{
-			const TapeVariable& var = x[cell.id];
 			return var.s * props_w.getDensity(var.p, var.xa, var.xw) *	(var.xa - props.xa_eqbm) *
 				reac.getReactionRate(props.m_init, var.m) / reac.comps[REACTS::ACID].mol_weight;
 		};
-		const adouble getPerm(const Cell& cell) const
+		template <typename T>
+		inline T getPerm(const Cell& cell, const T& m) const
 		{
-			adouble isNotFrac = (cell.type == CellType::INNER || cell.type == CellType::BORDER) ? true : false;
-			adouble tmp; 
-			condassign(tmp, isNotFrac, props_sk[0].getPermCoseni_x(x[cell.id].m), (adouble)(props_sk[0].kx * 1000.0));
-			return tmp;
+			if (cell.type == CellType::INNER || cell.type == CellType::BORDER)
+				return props_sk[0].getPermCoseni_x(m);
+			else
+				return props_sk[0].kx * 1000.0;
 		};
 		double getPermValue(const Cell& cell) const
 		{
-			if (cell.type == CellType::INNER || cell.type == CellType::BORDER)
-				return props_sk[0].getPermCoseni_x_value((*this)[cell.id].u_next.m);
-			else 
-				return props_sk[0].kx * 1000.0;
+			return getPerm(cell, static_cast<double>((*this)[cell.id].u_next.m));
+		};
+		// Geometric factors dist / (height * length) of both face sides, only permeability depends on porosity
+		struct FaceGeom
+		{
+			double g1, g2;
 		};
-		inline adouble getTrans(const Cell& cell, const size_t idx, const Cell& beta) const
+		std::vector<FaceGeom> faceGeom;
+		void setTrans();
+		template <typename T>
+		inline T getTrans(const Cell& cell, const size_t idx, const Cell& beta, const T& m, const T& m_beta) const
 		{
-			adouble k1 = getPerm(cell);
-			adouble k2 = getPerm(beta);
-			const double dist1 = cell.dist[idx];
-			const double dist2 = beta.getDistance(cell.id);
-			return props_sk[0].height * cell.length[idx] * k1 * k2 / (k1 * dist2 + k2 * dist1);
+			const size_t face_idx = mesh->getFaceIdx(cell, idx);
+			const auto& geom = faceGeom[face_idx];
+			const bool isFirst = (mesh->faces[face_idx].cell1 == cell.id);
+			const T k1 = getPerm(cell, m);
+			const T k2 = getPerm(beta, m_beta);
+			return 1.0 / ((isFirst ? geom.g1 : geom.g2) / k1 + (isFirst ? geom.g2 : geom.g1) / k2);
 		};
 
-		TapeVariable solveInner(const Cell& cell);
-		TapeVariable solveBorder(const Cell& cell);
+		template <class TState>
+		typename TState::Variable solveInner(const Cell& cell, const TState& st) const;
+		template <class TState>
+		typename TState::Variable solveBorder(const Cell& cell, const TState& st) const;
+		template <class TState>
+		typename TState::Variable solveWell(const Cell& cell, const TState& st) const;
 	public:
 		Acid2d();
 		~Acid2d();
@@ -1,6 +1,5 @@
 #include "src/models/Acid/Acid2dSolver.hpp"
 
-#include "adolc/sparse/sparsedrivers.h"
 #include "adolc/drivers/drivers.h"
 #include <iomanip>
 
@@ -23,11 +22,6 @@ Acid2dSolver::Acid2dSolver(Acid2d* _model) : AbstractSolver<Model>(_model)
 	ind_rhs = new int[strNum];
 	rhs = new double[strNum];
 
-	options[0] = 0;          /* sparsity pattern by index domains (default) */
-	options[1] = 0;          /*                         safe mode (default) */
-	options[2] = 0;          /*              not required if options[0] = 0 */
-	options[3] = 0;          /*                column compression (default) */
-
 	P.open("snaps/P.dat", ofstream::out);
 	S.open("snaps/S.dat", ofstream::out);
 	qcells.open("snaps/Q.dat", ofstream::out);
@@ -35,8 +29,28 @@ Acid2dSolver::Acid2dSolver(Acid2d* _model) : AbstractSolver<Model>(_model)
 	CHOP_MULT = 0.1;
 	MAX_SAT_CHANGE = 1.0;
 	
-	CONV_W2 = 1.e-4;		CONV_VAR = 1.e-10;
+	CONV_DX.fill(1.e-4);		CONV_AVER.fill(1.e-10);
+	// Porosity and pressure updates are relative to their initial values, saturation and
+	// concentrations are absolute; residuals are balances per unit volume and are taken
+	// relative to the initial mass of the phase or component in the unit volume
+	const auto& props = model->props_sk[0];
+	const double dens_w = model->props_w.getDensity(props.p_init, props.xa_init, props.xw_init);
+	const double dens_o = model->props_o.getDensity(props.p_init);
+	CONV_SCALE = { props.m_init, props.p_init, 1.0, 1.0, 1.0 };
+	CONV_RES = { (1.0 - props.m_init) * props.getDensity(props.p_init), props.m_init * dens_w, props.m_init * dens_o, props.m_init * dens_w, props.m_init * dens_w };
+	for (auto& tol : CONV_RES)
+		tol *= 1.e-8;
 	MAX_ITER = 20;
+
+	LINE_SEARCH = true;
+	LS_MAX_CUTS = 4;
+	LS_DECREASE = 1.e-4;
+	stepStats.resize(LS_MAX_CUTS + 2, 0);
+
+	KEEP_TAPE = true;
+	CACHE_SPARSITY = true;
+	JAC_TYPE = JAC_ENGINE::DUAL;
+	SOLVER_TYPE = LIN_SOLVER::PARALUTION;
 }
 Acid2dSolver::~Acid2dSolver()
 {
@@ -72,10 +86,11 @@ void Acid2dSolver::writeData()
 	P << cur_t * t_dim / 3600.0 << "\t" << p / (double)(model->Qcell.size()) << endl;
 	S << cur_t * t_dim / 3600.0 << "\t" << s / (double)(model->Qcell.size()) << endl;
 
+	// Total rate of the full domain
 	if (model->leftBoundIsRate)
-		qcells << "\t" << model->Q_sum * model->Q_dim * 86400.0 << endl;
+		qcells << "\t" << model->Q_sum * model->Q_dim * 86400.0 * mesh->symmetryFactor << endl;
 	else
-		qcells << "\t" << q * model->Q_dim * 86400.0 << endl;
+		qcells << "\t" << q * model->Q_dim * 86400.0 * mesh->symmetryFactor << endl;
 }
 void Acid2dSolver::control()
 {
@@ -105,6 +120,9 @@ void Acid2dSolver::start()
 
 	fillIndices();
 	solver.Init(var_size * model->cellsNum, 1.e-15, 1.e-15);
+	blockSolver.Init(model->cellsNum);
+	// Pressure is the second unknown of the cell
+	solver.InitCPR(var_size, 1);
 
 	model->setPeriod(curTimePeriod);
 
@@ -114,24 +132,67 @@ void Acid2dSolver::start()
 		model->snapshot_all(counter++);
 		doNextStep();
 		copyTimeLayer();
+		solver.NewTimeStep();
 		cout << "---------------------NEW TIME STEP---------------------" << endl;
 		cout << setprecision(6);
 		cout << "time = " << cur_t << endl;
 	}
 	model->snapshot_all(counter++);
 	writeData();
+	solver.PrintPrecondStats();
+	printStepStats();
 }
-void Acid2dSolver::copySolution(const paralution::LocalVector<double>& sol)
+template <class TVector>
+void Acid2dSolver::copySolution(const TVector& sol, const double alpha)
 {
 	for (size_t i = 0; i < size; i++)
 	{
-		auto& var = (*model)[i].u_next;
-		var.m += sol[i * var_size];
-		var.p += sol[i * var_size + 1];
-		var.s += sol[i * var_size + 2];
-		var.xa += sol[i * var_size + 3];
-		var.xw += sol[i * var_size + 4];
+		const auto data = (*model)[i];
+		data.u_iter.m = data.u_next.m + alpha * sol[i * var_size];
+		data.u_iter.p = data.u_next.p + alpha * sol[i * var_size + 1];
+		data.u_iter.s = data.u_next.s + alpha * sol[i * var_size + 2];
+		data.u_iter.xa = data.u_next.xa + alpha * sol[i * var_size + 3];
+		data.u_iter.xw = data.u_next.xw + alpha * sol[i * var_size + 4];
+	}
+	swapIterLayer();
+}
+template <class TVector>
+void Acid2dSolver::applyStep(const TVector& sol)
+{
+	if (!LINE_SEARCH)
+	{
+		copySolution(sol);
+		return;
 	}
+
+	// y holds the residual at the linearization point
+	const double norm0 = getResidualNorm();
+	double alpha = 1.0;
+	int cuts = 0;
+	while (true)
+	{
+		copySolution(sol, alpha);
+		computeResidual();
+		if (getResidualNorm() <= (1.0 - LS_DECREASE * alpha) * norm0)
+			break;
+		// The shortest step is taken even if it does not decrease the residual
+		if (cuts == LS_MAX_CUTS)
+		{
+			cuts++;
+			break;
+		}
+		revertIterLayer();
+		alpha *= 0.5;
+		cuts++;
+	}
+	stepStats[cuts]++;
+}
+void Acid2dSolver::printStepStats() const
+{
+	cout << "Line search accepted steps:" << endl;
+	for (int k = 0; k <= LS_MAX_CUTS; k++)
+		cout << "\t2^-" << k << "\t" << stepStats[k] << endl;
+	cout << "\tno decrease\t" << stepStats[LS_MAX_CUTS + 1] << endl;
 }
 void Acid2dSolver::checkStability()
 {
@@ -164,56 +225,78 @@ void Acid2dSolver::checkStability()
 
 	for (size_t i = 0; i < size; i++)
 	{
-		auto& data = (*model)[i];
+		const auto data = (*model)[i];
 		checkCritPoints(data.u_next, data.u_iter, model->props_sk[0]);
 		checkMaxResidual(data.u_next, data.u_iter);
 	}
 }
 void Acid2dSolver::solveStep()
 {
-	int cellIdx, varIdx;
-	err_newton = 1.0;
-	averValue(averValPrev);
-	std::fill(dAverVal.begin(), dAverVal.end(), 1.0);
+	resetConvergence();
+	resetForcingTerm();
 	iterations = 0;
 
-	auto continueIterations = [this]()
+	while (!isConverged() && iterations < MAX_ITER)
 	{
-		bool result = false;
-
-		for (const auto& val : dAverVal)
-			result += (val > CONV_VAR);
-		
-		return result * (err_newton > CONV_W2) * (iterations < MAX_ITER);
-	};
-
-	while (continueIterations())
-	{
-		copyIterLayer();
-
-		computeJac();
+		if (JAC_TYPE == JAC_ENGINE::DUAL)
+			computeJacDual();
+		else
+			computeJac();
 		fill();
-		solver.Assemble(ind_i, ind_j, a, elemNum, ind_rhs, rhs);
-		solver.Solve(PRECOND::ILU_SIMPLE);
-		copySolution(solver.getSolution());
+		const double eta = getForcingTerm();
+		bool isSolved = false;
+		if (SOLVER_TYPE == LIN_SOLVER::BLOCK)
+		{
+			blockSolver.SetRelTolerance(eta);
+			blockSolver.Assemble(&rowPtr[0], ind_j, a, rhs);
+			blockSolver.Solve();
+			// Unconverged block solution is not applied, the system is solved by Paralution instead
+			isSolved = blockSolver.getConverged();
+			if (isSolved)
+				applyStep(blockSolver.getSolution());
+			else
+				cout << "Block solver did not converge in " << blockSolver.getIterations() << " iterations" << endl;
+		}
+		if (!isSolved)
+		{
+			solver.Assemble(ind_i, ind_j, a, elemNum, ind_rhs, rhs);
+			solver.SetRelTolerance(eta);
+			solver.Solve(PRECOND::CPR);
+			applyStep(solver.getSolution());
+		}
 
 		checkStability();
-		err_newton = convergance(cellIdx, varIdx);
-
-		averValue(averVal);
-		for (int i = 0; i < var_size; i++)
-			dAverVal[i] = fabs(averVal[i] - averValPrev[i]);
-		averValPrev = averVal;
+		updateConvergence();
 
 		model->snapshot_all(iterations + 1);
 		iterations++;
 	}
 
-	cout << "Newton Iterations = " << iterations << endl;
+	printConvergence();
 }
 
+void Acid2dSolver::setTapeParams()
+{
+	const size_t prevSize = var_size * size;
+	tapeParams.resize(prevSize + 4);
+	for (size_t i = 0; i < prevSize; i++)
+		tapeParams[i] = model->u_prev[i];
+	tapeParams[prevSize] = model->ht;
+	tapeParams[prevSize + 1] = model->Q_sum;
+	tapeParams[prevSize + 2] = model->Pwf;
+	tapeParams[prevSize + 3] = model->xa;
+}
 void Acid2dSolver::computeJac()
 {
+	setTapeParams();
+	if (KEEP_TAPE && isTaped)
+	{
+		set_param_vec(0, tapeParams.size(), &tapeParams[0]);
+		// Negative value means that taped branches differ at the current point
+		if (zos_forward(0, var_size * size, var_size * size, 1, &model->u_next[0], y) >= 0)
+			return;
+	}
+
 	trace_on(0);
 
 	for (size_t i = 0; i < size; i++)
@@ -223,12 +306,24 @@ void Acid2dSolver::computeJac()
 		model->x[i].s <<= model->u_next[var_size * i + 2];
 		model->x[i].xa <<= model->u_next[var_size * i + 3];
 		model->x[i].xw <<= model->u_next[var_size * i + 4];
+
+		setTapeParam(model->x_prev[i].m, tapeParams[var_size * i]);
+		setTapeParam(model->x_prev[i].p, tapeParams[var_size * i + 1]);
+		setTapeParam(model->x_prev[i].s, tapeParams[var_size * i + 2]);
+		setTapeParam(model->x_prev[i].xa, tapeParams[var_size * i + 3]);
+		setTapeParam(model->x_prev[i].xw, tapeParams[var_size * i + 4]);
 	}
+	const size_t prevSize = var_size * size;
+	setTapeParam(model->tape_ht, tapeParams[prevSize]);
+	setTapeParam(model->tape_Q_sum, tapeParams[prevSize + 1]);
+	setTapeParam(model->tape_Pwf, tapeParams[prevSize + 2]);
+	setTapeParam(model->tape_xa, tapeParams[prevSize + 3]);
+	const TapeState st = { model->x, model->x_prev, model->tape_ht };
 	// Inner cells
 	for (size_t i = 0; i < mesh->inner_cells; i++)
 	{
 		const auto& cell = mesh->cells[i];
-		TapeVariable tmp = model->solveInner(cell);
+		TapeVariable tmp = model->solveInner(cell, st);
 		model->h[var_size * i] = tmp.m;
 		model->h[var_size * i + 1] = tmp.p;
 		model->h[var_size * i + 2] = tmp.s;
@@ -236,10 +331,21 @@ void Acid2dSolver::computeJac()
 		model->h[var_size * i + 4] = tmp.xw;
 	}
 	// Border cells
-	for (size_t i = mesh->border_beg; i < model->cellsNum; i++)
+	for (size_t i = mesh->border_beg; i < mesh->border_beg + mesh->border_edges; i++)
+	{
+		const auto& cell = mesh->cells[i];
+		TapeVariable tmp = model->solveBorder(cell, st);
+		model->h[var_size * i] = tmp.m;
+		model->h[var_size * i + 1] = tmp.p;
+		model->h[var_size * i + 2] = tmp.s;
+		model->h[var_size * i + 3] = tmp.xa;
+		model->h[var_size * i + 4] = tmp.xw;
+	}
+	// 1D fracture cells
+	for (size_t i = mesh->constrained_beg; i < mesh->constrained_beg + mesh->constrained_edges; i++)
 	{
 		const auto& cell = mesh->cells[i];
-		TapeVariable tmp = model->solveBorder(cell);
+		TapeVariable tmp = model->solveInner(cell, st);
 		model->h[var_size * i] = tmp.m;
 		model->h[var_size * i + 1] = tmp.p;
 		model->h[var_size * i + 2] = tmp.s;
@@ -258,14 +364,15 @@ void Acid2dSolver::computeJac()
 	// Well cell
 	const int well_idx = mesh->well_idx;
 	TapeVariable& cur = model->x[well_idx];
+	TapeVariable well = model->solveWell(mesh->cells[well_idx], st);
 	adouble leftIsRate = model->leftBoundIsRate;
-	adouble tmp = model->h[well_idx * var_size + 1];
+	model->h[well_idx * var_size] = well.m;
 	condassign(model->h[well_idx * var_size + 1], leftIsRate,
-		tmp - model->ht * model->props_w.getDensity(cur.p, cur.xa, cur.xw) * model->Q_sum / mesh->cells[well_idx].V,
-		(cur.p - model->Pwf) / model->P_dim);
+		well.p - model->tape_ht * model->props_w.getDensity(cur.p, cur.xa, cur.xw) * model->tape_Q_sum / mesh->well_vol,
+		(cur.p - model->tape_Pwf) / model->P_dim);
 	model->h[well_idx * var_size + 2] = (cur.s - (1.0 - model->props_sk[0].s_oc)) / model->P_dim;
-	model->h[well_idx * var_size + 3] = (cur.xa - model->xa) / model->P_dim;
-	model->h[well_idx * var_size + 4] = (cur.xw - (1.0 - model->xa)) / model->P_dim;
+	model->h[well_idx * var_size + 3] = (cur.xa - model->tape_xa) / model->P_dim;
+	model->h[well_idx * var_size + 4] = (cur.xw - (1.0 - model->tape_xa)) / model->P_dim;
 
 	for (size_t i = 0; i < size; i++)
 	{
@@ -274,11 +381,57 @@ void Acid2dSolver::computeJac()
 	}
 
 	trace_off();
+	isTaped = true;
+}
+template <class TState>
+typename TState::Variable Acid2dSolver::solveCell(const Cell& cell, const TState& st) const
+{
+	if (cell.id == mesh->well_idx)
+	{
+		typename TState::Variable res = model->solveWell(cell, st);
+		const auto& cur = st[cell.id];
+		if (model->leftBoundIsRate)
+			res.p -= st.ht * model->props_w.getDensity(cur.p, cur.xa, cur.xw) * model->Q_sum / mesh->well_vol;
+		else
+			res.p = (cur.p - model->Pwf) / model->P_dim;
+		res.s = (cur.s - (1.0 - model->props_sk[0].s_oc)) / model->P_dim;
+		res.xa = (cur.xa - model->xa) / model->P_dim;
+		res.xw = (cur.xw - (1.0 - model->xa)) / model->P_dim;
+		return res;
+	}
+	else if (cell.type == CellType::BORDER)
+		return model->solveBorder(cell, st);
+	else
+		return model->solveInner(cell, st);
+}
+void Acid2dSolver::computeJacDual()
+{
+	#pragma omp parallel num_threads(THREADS_NUM)
+	{
+		DualState state(model->u_next, model->u_prev, model->ht);
+		#pragma omp for schedule(static)
+		for (int i = 0; i < size; i++)
+		{
+			const auto& cell = mesh->cells[i];
+			assembleDualRow(cell, state, [&](const DualState& st) { return solveCell(cell, st); });
+		}
+	}
+}
+void Acid2dSolver::computeResidual()
+{
+	const ValueState st(model->u_next, model->u_prev, model->ht);
+	#pragma omp parallel for num_threads(THREADS_NUM) schedule(static)
+	for (int i = 0; i < size; i++)
+	{
+		const auto res = solveCell(mesh->cells[i], st);
+		for (int j = 0; j < var_size; j++)
+			y[var_size * i + j] = res[j];
+	}
 }
 void Acid2dSolver::fill()
 {
-	sparse_jac(0, var_size * model->cellsNum, var_size * model->cellsNum, repeat,
-		&model->u_next[0], &elemNum, (unsigned int**)(&ind_i), (unsigned int**)(&ind_j), &a, options);
+	if (JAC_TYPE == JAC_ENGINE::ADOLC)
+		computeSparseJac();
 
 	int counter = 0;
 	for (const auto& cell : mesh->cells)
@@ -4,6 +4,7 @@
 #include "src/models/AbstractSolver.hpp"
 #include "src/models/Acid/Acid2d.hpp"
 #include "src/solvers/ParalutionInterface.h"
+#include "src/solvers/BlockSolver.hpp"
 #include <fstream>
 
 namespace acid2d
@@ -15,16 +16,37 @@ namespace acid2d
 		void solveStep();
 		void writeData();
 
-		std::array<double, var_size> averVal, averValPrev, dAverVal;
-		double err_newton;
-
 		std::ofstream S, P, qcells;
 		ParSolver solver;
+		BlockSolver<var_size> blockSolver;
+		// Linear solver of the Newton iterations
+		LIN_SOLVER SOLVER_TYPE;
 
 		void checkStability();
+		void setTapeParams();
 		void computeJac();
 		void fill();
-		void copySolution(const paralution::LocalVector<double>& sol);
+
+		// Way to compute the Jacobian
+		JAC_ENGINE JAC_TYPE;
+		template <class TState>
+		typename TState::Variable solveCell(const Cell& cell, const TState& st) const;
+		void computeJacDual();
+		void computeResidual();
+		// Writes u_next + alpha * sol as the new iterate
+		template <class TVector>
+		void copySolution(const TVector& sol, const double alpha = 1.0);
+
+		// Backtracking line search on the residual norm evaluated without the Jacobian,
+		// the step is halved until the norm decreases by the factor 1 - LS_DECREASE * alpha
+		bool LINE_SEARCH;
+		int LS_MAX_CUTS;
+		double LS_DECREASE;
+		// Number of accepted steps of the length 2^-k, the last entry counts the shortest steps without decrease
+		std::vector<int> stepStats;
+		template <class TVector>
+		void applyStep(const TVector& sol);
+		void printStepStats() const;
 	public:
 		Acid2dSolver(acid2d::Acid2d* _model);
 		~Acid2dSolver();
@@ -15,9 +15,10 @@ namespace basic2d
 
 		double m_init;
 		double p_ref;
-		inline adouble getPoro(adouble p) const
+		template <typename T>
+		inline T getPoro(const T& p) const
 		{
-			return (adouble)(m_init)* ((adouble)(1.0) + (adouble)(beta)* (p - p_ref));
+			return m_init * (1.0 + beta * (p - p_ref));
 		};
 
 		// Permeability of colmatage zone [mD]
@@ -18,32 +18,25 @@ namespace acid2d
 		double xa_init;
 		double xw_init;
 
-		inline double getPermCoseni_x_value(const double m) const
+		template <typename T>
+		inline T getPermCoseni_x(const T& m) const
 		{
-			return kx * (m * m * m / (1 - m) / (1 - m)) /
-				(m_init * m_init * m_init / (1 - m_init) / (1 - m_init));
+			return kx * (m * m * m / (1.0 - m) / (1.0 - m)) / 
+							(m_init * m_init * m_init / (1.0 - m_init) / (1.0 - m_init));
 		};
-		inline double getPermCoseni_y_value(const double m) const
+		template <typename T>
+		inline T getPermCoseni_y(const T& m) const
 		{
-			return ky * (m * m * m / (1 - m) / (1 - m)) /
-				(m_init * m_init * m_init / (1 - m_init) / (1 - m_init));
-		};
-		inline adouble getPermCoseni_x(adouble m) const
-		{
-			return kx * (m * m * m / (1 - m) / (1 - m)) / 
-							(m_init * m_init * m_init / (1 - m_init) / (1 - m_init));
-		};
-		inline adouble getPermCoseni_y(adouble m) const
-		{
-			return ky * (m * m * m / (1 - m) / (1 - m)) /
-				(m_init * m_init * m_init / (1 - m_init) / (1 - m_init));
+			return ky * (m * m * m / (1.0 - m) / (1.0 - m)) /
+				(m_init * m_init * m_init / (1.0 - m_init) / (1.0 - m_init));
 		};
 		inline double getInitDiam(double m_init, double k0)
 		{
 			return sqrt(150.0 * k0 * (1.0 - m_init) * (1.0 - m_init) / m_init / m_init / m_init);
 		};
 
-		inline adouble getDensity(adouble p) const
+		template <typename T>
+		inline T getDensity(const T& p) const
 		{
 			return dens_stc;
 		};
@@ -55,20 +48,23 @@ namespace acid2d
 		//LiquidComponent water;
 
 		Interpolate* kr;
-		inline adouble getKr(adouble s, const Skeleton_Props& props) const
+		template <typename T>
+		inline T getKr(const T& s, const Skeleton_Props& props) const
 		{
-			adouble isAboveZero = (s - props.s_wc > 0.0) ? true : false;
-			adouble isAboveCritical = (s > 1.0 - props.s_oc) ? true : false;
-			adouble tmp;
-			condassign(tmp, isAboveZero, pow((s - (adouble)props.s_wc) / (adouble)(1.0 - props.s_wc - props.s_oc), 3.0), (adouble)0.0);
-			condassign(tmp, isAboveCritical, (adouble)1.0);
+			const T isAboveZero = s - props.s_wc;
+			const T isAboveCritical = s - (1.0 - props.s_oc);
+			T tmp;
+			condassign(tmp, isAboveZero, pow(isAboveZero / (1.0 - props.s_wc - props.s_oc), 3.0), T(0.0));
+			condassign(tmp, isAboveCritical, T(1.0));
 			return tmp;
 		};
-		inline adouble getViscosity(adouble p, adouble xa, adouble xw) const
+		template <typename T>
+		inline T getViscosity(const T& p, const T& xa, const T& xw) const
 		{
 			return visc;
 		};
-		inline adouble getDensity(adouble p, adouble xa, adouble xw) const
+		template <typename T>
+		inline T getDensity(const T& p, const T& xa, const T& xw) const
 		{
 			return dens_stc;
 		};
@@ -78,26 +74,30 @@ namespace acid2d
 		double gas_dens_stc;
 		//LiquidComponent oil;
 		Interpolate* b;
-		inline adouble getB(adouble p) const
+		template <typename T>
+		inline T getB(const T& p) const
 		{
-			return exp(-(adouble)beta * (p - p_ref));
+			return exp(-beta * (p - p_ref));
 		};
-		inline adouble getDensity(adouble p) const
+		template <typename T>
+		inline T getDensity(const T& p) const
 		{
 			return dens_stc / getB(p);
 		};
 
 		Interpolate* kr;
-		inline adouble getKr(adouble s, const Skeleton_Props& props) const
+		template <typename T>
+		inline T getKr(const T& s, const Skeleton_Props& props) const
 		{
-			adouble isAboveZero = (1.0 - s - props.s_oc > 0.0) ? true : false;
-			adouble isAboveCritical = (1.0 - s > 1.0 - props.s_wc) ? true : false;
-			adouble tmp;
-			condassign(tmp, isAboveZero, pow((1.0 - s - (adouble)props.s_oc) / (adouble)(1.0 - props.s_wc - props.s_oc), 3.0), (adouble)0.0);
-			condassign(tmp, isAboveCritical, (adouble)1.0);
+			const T isAboveZero = 1.0 - props.s_oc - s;
+			const T isAboveCritical = props.s_wc - s;
+			T tmp;
+			condassign(tmp, isAboveZero, pow(isAboveZero / (1.0 - props.s_wc - props.s_oc), 3.0), T(0.0));
+			condassign(tmp, isAboveCritical, T(1.0));
 			return tmp;
 		};
-		inline adouble getViscosity(adouble p) const
+		template <typename T>
+		inline T getViscosity(const T& p) const
 		{
 			return visc;
 		};
@@ -23,37 +23,43 @@ namespace acid2d
 	};
 	struct SolidComponent : Component
 	{
-		inline adouble getMolarDensity(adouble p) const
+		template <typename T>
+		inline T getMolarDensity(const T& p) const
 		{
 			return rho_stc / mol_weight;
 		};
 		double beta;
-		inline adouble getDensity(adouble p) const
+		template <typename T>
+		inline T getDensity(const T& p) const
 		{
 			return rho_stc;
 		};
 	};
 	struct LiquidComponent : Component
 	{
-		inline adouble getMolarDensity(adouble p) const
+		template <typename T>
+		inline T getMolarDensity(const T& p) const
 		{
 			return getDensity(p) / mol_weight;
 		};
 		double beta;
-		inline adouble getDensity(adouble p) const
+		template <typename T>
+		inline T getDensity(const T& p) const
 		{
-			return (adouble)(rho_stc)* ((adouble)(1.0) + (adouble)(beta)* (p - p_std));
+			return rho_stc * (1.0 + beta * (p - p_std));
 		};
 	};
 	struct GasComponent : Component
 	{
-		inline adouble getMolarDensity(adouble p) const
+		template <typename T>
+		inline T getMolarDensity(const T& p) const
 		{
 			return getDensity(p) / mol_weight;
 		};
 		double z;
 		Interpolate* z_table;
-		inline adouble getDensity(adouble p) const
+		template <typename T>
+		inline T getDensity(const T& p) const
 		{
 			//return p * (adouble)(mol_weight / (z * R * T));
 			return rho_stc * p / p_std;
@@ -106,7 +112,8 @@ namespace acid2d
 		double surf_init;
 		double activation_energy;
 		double reaction_const;
-		inline adouble getReactionRate(double m0, adouble m) const
+		template <typename T>
+		inline T getReactionRate(const double m0, const T& m) const
 		{
 			return reaction_const * surf_init * (1.0 - m) / (1 - m0) *
 				exp(-activation_energy / Component::R / Component::T);
@@ -3,7 +3,8 @@
 
 #include "src/models/Element.hpp"
 
-	enum CellType { INNER, FRAC, BORDER, WELL };
+	// CONSTRAINED cells are 1D fracture segments lying on the edges between two inner cells
+	enum CellType { INNER, FRAC, BORDER, WELL, CONSTRAINED };
 	class TriangleCell
 	{
 	public:
@@ -14,6 +14,7 @@ Oil2d::~Oil2d()
 {
 
 	delete[] x, h;
+	delete[] x_prev;
 }
 void Oil2d::setProps(const Properties& props)
 {
@@ -97,6 +98,17 @@ void Oil2d::makeDimLess()
 
 	alpha /= t_dim;
 }
+void Oil2d::setTrans()
+{
+	trans.resize(mesh->faces.size());
+	for (size_t i = 0; i < mesh->faces.size(); i++)
+	{
+		const auto& face = mesh->faces[i];
+		const double k1 = getPerm(mesh->cells[face.cell1]);
+		const double k2 = getPerm(mesh->cells[face.cell2]);
+		trans[i] = props_sk[0].height * face.length * k1 * k2 / (k1 * face.dist2 + k2 * face.dist1);
+	}
+}
 void Oil2d::setInitialState()
 {
 	const auto& props = props_sk[0];
@@ -111,6 +123,7 @@ void Oil2d::setInitialState()
 	}
 
 	x = new TapeVariable[cellsNum];
+	x_prev = new TapeVariable[cellsNum];
 	h = new adouble[var_size * cellsNum];
 }
 void Oil2d::setPeriod(const int period)
@@ -141,53 +154,131 @@ double Oil2d::getRate(const size_t cell_idx)
 	return 0.0;
 }
 
-adouble Oil2d::solveInner(const Cell& cell)
+template <class TState>
+typename TState::Scalar Oil2d::solveInner(const Cell& cell, const TState& st) const
 {
-	const auto& cur = x[cell.id];
-	const auto prev = (*this)[cell.id].u_prev;
+	typedef typename TState::Scalar Scalar;
+	const auto& cur = st[cell.id];
+	const auto& prev = st.prev(cell.id);
 
-	adouble H = props_sk[0].getPoro(cur.p) * props_oil.getDensity(cur.p) - props_sk[0].getPoro(prev.p) * props_oil.getDensity(prev.p);
-	for (int i = 0; i < 3; i++)
+	Scalar H = props_sk[0].getPoro(cur.p) * props_oil.getDensity(cur.p) - props_sk[0].getPoro(prev.p) * props_oil.getDensity(prev.p);
+	const Scalar mob = props_oil.getDensity(cur.p) / props_oil.getViscosity(cur.p);
+	for (int i = 0; i < mesh->getNebrsNum(cell); i++)
 	{
-		const int nebr_idx = cell.nebr[i];
+		const int nebr_idx = mesh->getNebr(cell, i);
 		const auto& beta = mesh->cells[nebr_idx];
-		const auto& nebr = x[nebr_idx];
+		const auto& nebr = st[nebr_idx];
+
+		const auto& face = mesh->getFace(cell, i);
 
-		H += ht / cell.V * getTrans(cell, i, beta) *
-			linearAppr(props_oil.getDensity(cur.p) / props_oil.getViscosity(cur.p), cell.dist[i],
-				props_oil.getDensity(nebr.p) / props_oil.getViscosity(nebr.p), getDistance(beta, cell)) *
-				(cur.p - nebr.p);
+		const Scalar mob_nebr = props_oil.getDensity(nebr.p) / props_oil.getViscosity(nebr.p);
+		H += st.ht / cell.V * getTrans(cell, i, beta) *
+			linearAppr(mob, face.getDistance(cell.id), mob_nebr, face.getDistance(beta.id)) * (cur.p - nebr.p);
 	}
 	return H;
 }
-adouble Oil2d::solveBorder(const Cell& cell)
+template <class TState>
+typename TState::Scalar Oil2d::solveBorder(const Cell& cell, const TState& st) const
 {
-	const auto& cur = x[cell.id];
-	const auto& nebr = x[cell.nebr[0]];
-	adouble H;
-	adouble rightIsPres = rightBoundIsPres;
-	condassign(H, rightIsPres, (cur.p - (adouble)(props_sk[0].p_out)) / P_dim, (cur.p - nebr.p) / P_dim);
+	const auto& cur = st[cell.id];
+	const auto& nebr = st[cell.nebr[0]];
 
-	return H;
+	// Symmetry lines are no-flow boundaries
+	if (rightBoundIsPres && !mesh->isSymmetry(cell.id))
+		return (cur.p - props_sk[0].p_out) / P_dim;
+	else
+		return (cur.p - nebr.p) / P_dim;
 }
-adouble Oil2d::solveWell(const Cell& cell)
+template <class TState>
+typename TState::Scalar Oil2d::solveWell(const Cell& cell, const TState& st) const
 {
-	const auto& cur = x[cell.id];
-	const auto prev = (*this)[cell.id].u_prev;
+	typedef typename TState::Scalar Scalar;
+	const auto& cur = st[cell.id];
+	const auto& prev = st.prev(cell.id);
 
-	adouble H = props_sk[0].getPoro(cur.p) * props_oil.getDensity(cur.p) - props_sk[0].getPoro(prev.p) * props_oil.getDensity(prev.p);
+	// PEACEMAN wellbore has no pore volume
+	Scalar H = 0.0;
+	if (mesh->wellModel == WELL_MODEL::MESHED)
+		H = props_sk[0].getPoro(cur.p) * props_oil.getDensity(cur.p) - props_sk[0].getPoro(prev.p) * props_oil.getDensity(prev.p);
+	const Scalar mob = props_oil.getDensity(cur.p) / props_oil.getViscosity(cur.p);
 	for (int i = 0; i < mesh->wellNebrs.size(); i++)
 	{
 		const auto& nebr_str = mesh->wellNebrs[i];
 		const int nebr_idx = nebr_str.id;
 		const auto& beta = mesh->cells[nebr_idx];
-		const auto& nebr = x[nebr_idx];
+		const auto& nebr = st[nebr_idx];
 
-		H += ht / mesh->well_vol * getTrans(cell, i, beta) *
-			linearAppr(props_oil.getDensity(cur.p) / props_oil.getViscosity(cur.p), nebr_str.dist,
-				props_oil.getDensity(nebr.p) / props_oil.getViscosity(nebr.p), getDistance(beta, cell)) *
-				(cur.p - nebr.p);
+		const auto& face = mesh->getFace(cell, i);
+
+		const Scalar mob_nebr = props_oil.getDensity(nebr.p) / props_oil.getViscosity(nebr.p);
+		H += st.ht / mesh->well_vol * getTrans(cell, i, beta) *
+			linearAppr(mob, face.getDistance(cell.id), mob_nebr, face.getDistance(beta.id)) * (cur.p - nebr.p);
 	}
 
 	return H;
-}
\ No newline at end of file
+}
+template TapeState::Scalar Oil2d::solveInner<TapeState>(const Cell& cell, const TapeState& st) const;
+template ValueState::Scalar Oil2d::solveInner<ValueState>(const Cell& cell, const ValueState& st) const;
+template DualState::Scalar Oil2d::solveInner<DualState>(const Cell& cell, const DualState& st) const;
+template TapeState::Scalar Oil2d::solveBorder<TapeState>(const Cell& cell, const TapeState& st) const;
+template ValueState::Scalar Oil2d::solveBorder<ValueState>(const Cell& cell, const ValueState& st) const;
+template DualState::Scalar Oil2d::solveBorder<DualState>(const Cell& cell, const DualState& st) const;
+template TapeState::Scalar Oil2d::solveWell<TapeState>(const Cell& cell, const TapeState& st) const;
+template ValueState::Scalar Oil2d::solveWell<ValueState>(const Cell& cell, const ValueState& st) const;
+template DualState::Scalar Oil2d::solveWell<DualState>(const Cell& cell, const DualState& st) const;
+
+double Oil2d::solveInner(const Cell& cell, double* jac) const
+{
+	const auto& props = props_sk[0];
+	const double p = (*this)[cell.id].u_next.p;
+	const double p_prev = (*this)[cell.id].u_prev.p;
+
+	double H = props.getPoro_value(p) * props_oil.getDensity_value(p) - props.getPoro_value(p_prev) * props_oil.getDensity_value(p_prev);
+	jac[0] = props.getPoro_dp(p) * props_oil.getDensity_value(p) + props.getPoro_value(p) * props_oil.getDensity_dp(p);
+	for (int i = 0; i < mesh->getNebrsNum(cell); i++)
+	{
+		const auto& beta = mesh->cells[mesh->getNebr(cell, i)];
+		double dcur;
+		H += getFlux(cell, i, beta, cell.V, dcur, jac[i + 1]);
+		jac[0] += dcur;
+	}
+	return H;
+}
+double Oil2d::solveBorder(const Cell& cell, double* jac) const
+{
+	const double p = (*this)[cell.id].u_next.p;
+	jac[0] = 1.0 / P_dim;
+	if (rightBoundIsPres && !mesh->isSymmetry(cell.id))
+	{
+		jac[1] = 0.0;
+		return (p - props_sk[0].p_out) / P_dim;
+	}
+	else
+	{
+		jac[1] = -1.0 / P_dim;
+		return (p - (*this)[cell.nebr[0]].u_next.p) / P_dim;
+	}
+}
+double Oil2d::solveWell(const Cell& cell, double* jac) const
+{
+	const auto& props = props_sk[0];
+	const double p = (*this)[cell.id].u_next.p;
+	const double p_prev = (*this)[cell.id].u_prev.p;
+
+	double H = 0.0;
+	jac[0] = 0.0;
+	if (mesh->wellModel == WELL_MODEL::MESHED)
+	{
+		H = props.getPoro_value(p) * props_oil.getDensity_value(p) - props.getPoro_value(p_prev) * props_oil.getDensity_value(p_prev);
+		jac[0] = props.getPoro_dp(p) * props_oil.getDensity_value(p) + props.getPoro_value(p) * props_oil.getDensity_dp(p);
+	}
+	for (int i = 0; i < mesh->wellNebrs.size(); i++)
+	{
+		const auto& nebr_str = mesh->wellNebrs[i];
+		const auto& beta = mesh->cells[nebr_str.id];
+		double dcur;
+		H += getFlux(cell, i, beta, mesh->well_vol, dcur, jac[i + 1]);
+		jac[0] += dcur;
+	}
+	return H;
+}
@@ -8,6 +8,9 @@
 namespace oil2d
 {
 	typedef var::containers::TapeVar1Phase TapeVariable;
+	typedef var::TapeState<TapeVariable> TapeState;
+	typedef var::ValueState<var::containers::ScalarVar1Phase> ValueState;
+	typedef var::DualState<var::containers::ScalarVar1Phase, mesh::stencil * TapeVariable::size> DualState;
 	class Oil2d : public AbstractModel<var::containers::Var1phase, Properties, var::BasicVariables, Oil2d>
 	{
 		template<typename> friend class VTKSnapshotter;
@@ -18,6 +21,7 @@ namespace oil2d
 		void setInitialState();
 
 		TapeVariable* x;
+		TapeVariable* x_prev;
 		adouble* h;
 
 		std::vector<Skeleton_Props> props_sk;
@@ -30,33 +34,50 @@ namespace oil2d
 			else
 				return props_sk[0].kx * 1000.0;
 		};
-		double getTrans(const Cell& cell1, const int idx, const Cell& cell2) const
+		// Transmissibilities of faces depend only on geometry and static permeability
+		std::vector<double> trans;
+		void setTrans();
+		inline double getTrans(const Cell& cell, const int idx, const Cell& beta) const
 		{
-			const double k1 = getPerm(cell1);
-			const double k2 = getPerm(cell2);
-			const double dist1 = getDistance(cell1, cell2);
-			const double dist2 = getDistance(cell2, cell1);
-			if(cell1.type == CellType::WELL)
-				return props_sk[0].height * mesh->wellNebrs[idx].length * k1 * k2 / (k1 * dist2 + k2 * dist1);
-			else
-				return props_sk[0].height * cell1.length[idx] * k1 * k2 / (k1 * dist2 + k2 * dist1);
+			return trans[mesh->getFaceIdx(cell, idx)];
 		};
-		const double& getDistance(const Cell& cell, const Cell& beta) const
+
+		template <class TState>
+		typename TState::Scalar solveInner(const Cell& cell, const TState& st) const;
+		template <class TState>
+		typename TState::Scalar solveBorder(const Cell& cell, const TState& st) const;
+		template <class TState>
+		typename TState::Scalar solveWell(const Cell& cell, const TState& st) const;
+
+		// Residuals with hand-written derivatives
+		// jac[0] is the derivative by the cell pressure, jac[i + 1] is the one by the i-th neighbour pressure
+		// Perforated cells of the PEACEMAN well have the well as the 4th neighbour
+		inline double getFlux(const Cell& cell, const int idx, const Cell& beta, const double vol,
+								double& dcur, double& dnebr) const
 		{
-			if (cell.type == CellType::WELL && beta.type != CellType::WELL)
-			{
-				for (const auto& nebr : mesh->wellNebrs)
-					if (nebr.id == beta.id)
-						return nebr.dist;
-				return 0.0;
-			}
-			else
-				return cell.getDistance(beta.id);
-		};
+			const double p = (*this)[cell.id].u_next.p;
+			const double p_nebr = (*this)[beta.id].u_next.p;
+			const auto& face = mesh->getFace(cell, idx);
+			const double dist = face.getDistance(cell.id);
+			const double dist_nebr = face.getDistance(beta.id);
+			const double w = dist_nebr / (dist + dist_nebr);
+
+			const double visc = props_oil.getViscosity_value(p);
+			const double visc_nebr = props_oil.getViscosity_value(p_nebr);
+			const double mob = props_oil.getDensity_value(p) / visc;
+			const double mob_nebr = props_oil.getDensity_value(p_nebr) / visc_nebr;
+			const double dmob = (props_oil.getDensity_dp(p) - mob * props_oil.getViscosity_dp(p)) / visc;
+			const double dmob_nebr = (props_oil.getDensity_dp(p_nebr) - mob_nebr * props_oil.getViscosity_dp(p_nebr)) / visc_nebr;
 
-		adouble solveInner(const Cell& cell);
-		adouble solveBorder(const Cell& cell);
-		adouble solveWell(const Cell& cell);
+			const double mult = ht / vol * getTrans(cell, idx, beta);
+			const double mob_face = w * mob + (1.0 - w) * mob_nebr;
+			dcur = mult * (mob_face + w * dmob * (p - p_nebr));
+			dnebr = mult * ((1.0 - w) * dmob_nebr * (p - p_nebr) - mob_face);
+			return mult * mob_face * (p - p_nebr);
+		};
+		double solveInner(const Cell& cell, double* jac) const;
+		double solveBorder(const Cell& cell, double* jac) const;
+		double solveWell(const Cell& cell, double* jac) const;
 	public:
 		Oil2d();
 		~Oil2d();
@@ -1,7 +1,7 @@
 #include "src/models/Oil2d/Oil2dSolver.hpp"
+#include "src/util/utils.h"
 #include <iostream>
 
-#include "adolc/sparse/sparsedrivers.h"
 #include "adolc/drivers/drivers.h"
 
 using namespace oil2d;
@@ -9,6 +9,7 @@ using std::vector;
 using std::ofstream;
 using std::map;
 using std::endl;
+using std::cout;
 using std::setprecision;
 
 Oil2dSolver::Oil2dSolver(Model* _model) : AbstractSolver<Model>(_model)
@@ -23,10 +24,21 @@ Oil2dSolver::Oil2dSolver(Model* _model) : AbstractSolver<Model>(_model)
 	ind_rhs = new int[strNum];
 	rhs = new double[strNum];
 
-	options[0] = 0;          /* sparsity pattern by index domains (default) */
-	options[1] = 0;          /*                         safe mode (default) */
-	options[2] = 0;          /*              not required if options[0] = 0 */
-	options[3] = 0;          /*                column compression (default) */
+	KEEP_TAPE = true;
+	CACHE_SPARSITY = true;
+
+	JAC_TYPE = JAC_ENGINE::ANALYTIC;
+	SOLVER_TYPE = LIN_SOLVER::PARALUTION;
+	CHECK_JAC = false;
+	isJacChecked = false;
+	jacRow.resize(std::max(size_t(5), mesh->wellNebrs.size() + 1));
+
+	// Pressure updates are relative to the initial pressure, residual is the mass balance
+	// of the mean cell and is taken relative to its initial mass
+	const auto& props = model->props_sk[0];
+	const double cellMass = props.getPoro_value(props.p_init) * model->props_oil.getDensity_value(props.p_init) * mesh->Volume / mesh->inner_cells;
+	CONV_SCALE[0] = props.p_init;
+	CONV_RES[0] = 1.e-8 * cellMass;
 
 	plot_P.open("snaps/P.dat", ofstream::out);
 	plot_Q.open("snaps/Q.dat", ofstream::out);
@@ -65,10 +77,11 @@ void Oil2dSolver::writeData()
 	}
 	plot_P << cur_t * t_dim / 3600.0 << "\t" << p / (double)(model->Qcell.size()) << endl;
 
+	// Total rate of the full domain
 	if (model->leftBoundIsRate)
-		plot_Q << "\t" << model->Q_sum * model->Q_dim * 86400.0 << endl;
+		plot_Q << "\t" << model->Q_sum * model->Q_dim * 86400.0 * mesh->symmetryFactor << endl;
 	else
-		plot_Q << "\t" << q * model->Q_dim * 86400.0 << endl;
+		plot_Q << "\t" << q * model->Q_dim * 86400.0 * mesh->symmetryFactor << endl;
 }
 void Oil2dSolver::control()
 {
@@ -98,6 +111,7 @@ void Oil2dSolver::start()
 
 	fillIndices();
 	solver.Init(Model::var_size * model->cellsNum, 1.e-15, 1.e-15);
+	blockSolver.Init(model->cellsNum);
 
 	model->setPeriod(curTimePeriod);
 	while (cur_t < Tt)
@@ -106,56 +120,108 @@ void Oil2dSolver::start()
 		model->snapshot_all(counter++);
 		doNextStep();
 		copyTimeLayer();
+		solver.NewTimeStep();
 		cout << "---------------------NEW TIME STEP---------------------" << endl;
 		cout << setprecision(6);
 		cout << "time = " << cur_t << endl;
 	}
 	model->snapshot_all(counter++);
 	writeData();
+	solver.PrintPrecondStats();
 }
 void Oil2dSolver::solveStep()
 {
-	int cellIdx, varIdx;
-	double err_newton = 1.0;
-	double averPrev = averValue(0), aver, dAver = 1.0;
-
+	resetConvergence();
+	resetForcingTerm();
 	iterations = 0;
-	while (err_newton > 1.e-4 /*&& (dAverSat > 1.e-9 || dAverPres > 1.e-7)*/ && iterations < 20)
+	while (!isConverged() && iterations < MAX_ITER)
 	{
-		copyIterLayer();
+		if (CHECK_JAC && !isJacChecked && JAC_TYPE != JAC_ENGINE::ADOLC)
+		{
+			const double jacErr = checkJac();
+			cout << "Jacobian relative error = " << jacErr << endl;
+			if (jacErr > 1.e-8)
+				cout << "Warning: Jacobian differs from ADOL-C one" << endl;
+			isJacChecked = true;
+		}
 
-		computeJac();
+		if (JAC_TYPE == JAC_ENGINE::ANALYTIC)
+			computeJacAnalytic();
+		else if (JAC_TYPE == JAC_ENGINE::DUAL)
+			computeJacDual();
+		else
+			computeJac();
 		fill();
-		solver.Assemble(ind_i, ind_j, a, elemNum, ind_rhs, rhs);
- 		solver.Solve(PRECOND::ILU_SIMPLE);
-		copySolution(solver.getSolution());
-
-		//if (repeat == 0)
-		//	repeat = 1;
-
-		err_newton = convergance(cellIdx, varIdx);
-		aver = averValue(0);		dAver = fabs(aver - averPrev);		averPrev = aver;
+		const double eta = getForcingTerm();
+		bool isSolved = false;
+		if (SOLVER_TYPE == LIN_SOLVER::BLOCK)
+		{
+			blockSolver.SetRelTolerance(eta);
+			blockSolver.Assemble(&rowPtr[0], ind_j, a, rhs);
+			blockSolver.Solve();
+			// Unconverged block solution is not applied, the system is solved by Paralution instead
+			isSolved = blockSolver.getConverged();
+			if (isSolved)
+				copySolution(blockSolver.getSolution());
+			else
+				cout << "Block solver did not converge in " << blockSolver.getIterations() << " iterations" << endl;
+		}
+		if (!isSolved)
+		{
+			solver.Assemble(ind_i, ind_j, a, elemNum, ind_rhs, rhs);
+			solver.SetRelTolerance(eta);
+			solver.Solve(PRECOND::ILU_SIMPLE);
+			copySolution(solver.getSolution());
+		}
+		updateConvergence();
 		iterations++;
 	}
 
-	cout << "Newton Iterations = " << iterations << endl;
+	printConvergence();
 }
-void Oil2dSolver::copySolution(const paralution::LocalVector<double>& sol)
+template <class TVector>
+void Oil2dSolver::copySolution(const TVector& sol)
 {
 	for (int i = 0; i < size; i++)
 	{
-		auto& var = (*model)[i].u_next;
-		var.p += sol[Model::var_size * i];
+		const auto data = (*model)[i];
+		data.u_iter.p = data.u_next.p + sol[Model::var_size * i];
 	}
+	swapIterLayer();
 }
 
+void Oil2dSolver::setTapeParams()
+{
+	tapeParams.resize(size + 3);
+	for (size_t i = 0; i < size; i++)
+		tapeParams[i] = model->u_prev[i * var_size];
+	tapeParams[size] = model->ht;
+	tapeParams[size + 1] = model->Q_sum;
+	tapeParams[size + 2] = model->Pwf;
+}
 void Oil2dSolver::computeJac()
 {
+	setTapeParams();
+	if (KEEP_TAPE && isTaped)
+	{
+		set_param_vec(0, tapeParams.size(), &tapeParams[0]);
+		// Negative value means that taped branches differ at the current point
+		if (zos_forward(0, Model::var_size * size, Model::var_size * size, 1, &model->u_next[0], y) >= 0)
+			return;
+	}
+
 	trace_on(0);
 
 	for (size_t i = 0; i < size; i++)
+	{
 		model->x[i].p <<= model->u_next[i * var_size];
+		setTapeParam(model->x_prev[i].p, tapeParams[i]);
+	}
+	setTapeParam(model->tape_ht, tapeParams[size]);
+	setTapeParam(model->tape_Q_sum, tapeParams[size + 1]);
+	setTapeParam(model->tape_Pwf, tapeParams[size + 2]);
 
+	const TapeState st = { model->x, model->x_prev, model->tape_ht };
 	const int well_idx = model->cellsNum - 1;
 	for (int i = 0; i < mesh->inner_cells; i++)
 	{
@@ -163,29 +229,163 @@ void Oil2dSolver::computeJac()
 		adouble isWellCell = (cell.type == CellType::WELL) ? true : false;
 		condassign(model->h[i], isWellCell,
 			(model->x[cell.id].p - model->x[well_idx].p) / model->P_dim,
-			cell.V * model->solveInner(cell));
+			cell.V * model->solveInner(cell, st));
 	}
-	for (int i = mesh->border_beg; i < model->cellsNum - 1; i++)
+	for (int i = mesh->border_beg; i < mesh->border_beg + mesh->border_edges; i++)
 	{
 		const auto& cell = mesh->cells[i];
-		model->h[i] = model->solveBorder(cell);
+		model->h[i] = model->solveBorder(cell, st);
+	}
+	for (int i = mesh->constrained_beg; i < mesh->constrained_beg + mesh->constrained_edges; i++)
+	{
+		const auto& cell = mesh->cells[i];
+		model->h[i] = cell.V * model->solveInner(cell, st);
 	}
 	
 	adouble leftIsRate = model->leftBoundIsRate;
-	adouble tmp = model->solveWell(mesh->cells[well_idx]);
+	adouble tmp = model->solveWell(mesh->cells[well_idx], st);
 	condassign(model->h[well_idx], leftIsRate,
-		tmp + model->ht * model->props_oil.getDensity(model->x[well_idx].p) * model->Q_sum,
-		(model->x[well_idx].p - model->Pwf) / model->P_dim);
+		tmp + model->tape_ht * model->props_oil.getDensity(model->x[well_idx].p) * model->tape_Q_sum,
+		(model->x[well_idx].p - model->tape_Pwf) / model->P_dim);
 
 	for (int i = 0; i < Model::var_size * size; i++)
 		model->h[i] >>= y[i];
 
 	trace_off();
+	isTaped = true;
+}
+void Oil2dSolver::computeJacAnalytic()
+{
+	std::fill_n(a, elemNum, 0.0);
+
+	const int well_idx = mesh->well_idx;
+	#pragma omp parallel for num_threads(THREADS_NUM) schedule(static)
+	for (int i = 0; i < mesh->inner_cells; i++)
+	{
+		double jac[5];
+		const auto& cell = mesh->cells[i];
+		if (cell.type == CellType::WELL)
+		{
+			y[i] = ((*model)[i].u_next.p - (*model)[well_idx].u_next.p) / model->P_dim;
+			a[getElemIdx(i, i)] += 1.0 / model->P_dim;
+			a[getElemIdx(i, well_idx)] -= 1.0 / model->P_dim;
+		}
+		else
+		{
+			y[i] = cell.V * model->solveInner(cell, jac);
+			a[getElemIdx(i, i)] += cell.V * jac[0];
+			for (int j = 0; j < mesh->getNebrsNum(cell); j++)
+				a[getElemIdx(i, mesh->getNebr(cell, j))] += cell.V * jac[j + 1];
+		}
+	}
+	#pragma omp parallel for num_threads(THREADS_NUM) schedule(static)
+	for (int i = mesh->border_beg; i < mesh->border_beg + mesh->border_edges; i++)
+	{
+		double jac[2];
+		const auto& cell = mesh->cells[i];
+		y[i] = model->solveBorder(cell, jac);
+		a[getElemIdx(i, i)] += jac[0];
+		a[getElemIdx(i, cell.nebr[0])] += jac[1];
+	}
+	// 1D fracture cells may have many neighbours at junctions
+	std::vector<double> fracJac;
+	for (int i = mesh->constrained_beg; i < mesh->constrained_beg + mesh->constrained_edges; i++)
+	{
+		const auto& cell = mesh->cells[i];
+		fracJac.resize(mesh->getNebrsNum(cell) + 1);
+		y[i] = cell.V * model->solveInner(cell, &fracJac[0]);
+		a[getElemIdx(i, i)] += cell.V * fracJac[0];
+		for (int j = 0; j < mesh->getNebrsNum(cell); j++)
+			a[getElemIdx(i, mesh->getNebr(cell, j))] += cell.V * fracJac[j + 1];
+	}
+
+	double* jac = &jacRow[0];
+	const auto& well = mesh->cells[well_idx];
+	const double p_well = (*model)[well_idx].u_next.p;
+	if (model->leftBoundIsRate)
+	{
+		y[well_idx] = model->solveWell(well, jac) + model->ht * model->props_oil.getDensity_value(p_well) * model->Q_sum;
+		a[getElemIdx(well_idx, well_idx)] += jac[0] + model->ht * model->props_oil.getDensity_dp(p_well) * model->Q_sum;
+		for (int j = 0; j < mesh->wellNebrs.size(); j++)
+			a[getElemIdx(well_idx, mesh->wellNebrs[j].id)] += jac[j + 1];
+	}
+	else
+	{
+		y[well_idx] = (p_well - model->Pwf) / model->P_dim;
+		a[getElemIdx(well_idx, well_idx)] += 1.0 / model->P_dim;
+	}
+}
+template <class TState>
+typename TState::Scalar Oil2dSolver::solveCell(const Cell& cell, const TState& st) const
+{
+	const int well_idx = mesh->well_idx;
+	if (cell.id == well_idx)
+	{
+		const auto& cur = st[well_idx];
+		if (model->leftBoundIsRate)
+			return model->solveWell(cell, st) + st.ht * model->props_oil.getDensity(cur.p) * model->Q_sum;
+		else
+			return (cur.p - model->Pwf) / model->P_dim;
+	}
+	else if (cell.type == CellType::BORDER)
+		return model->solveBorder(cell, st);
+	else if (cell.type == CellType::WELL)
+		return (st[cell.id].p - st[well_idx].p) / model->P_dim;
+	else
+		return cell.V * model->solveInner(cell, st);
+}
+void Oil2dSolver::computeJacDual()
+{
+	typedef DualState::Variable Variable;
+	#pragma omp parallel num_threads(THREADS_NUM)
+	{
+		DualState state(model->u_next, model->u_prev, model->ht);
+		#pragma omp for schedule(static)
+		for (int i = 0; i < size; i++)
+		{
+			const auto& cell = mesh->cells[i];
+			assembleDualRow(cell, state, [&](const DualState& st) -> Variable { return{ solveCell(cell, st) }; });
+		}
+	}
+}
+void Oil2dSolver::computeResidual()
+{
+	const ValueState st(model->u_next, model->u_prev, model->ht);
+	#pragma omp parallel for num_threads(THREADS_NUM) schedule(static)
+	for (int i = 0; i < size; i++)
+		y[i] = solveCell(mesh->cells[i], st);
+}
+double Oil2dSolver::checkJac()
+{
+	if (JAC_TYPE == JAC_ENGINE::ANALYTIC)
+		computeJacAnalytic();
+	else
+		computeJacDual();
+	const vector<double> a_analytic(a, a + elemNum);
+	const vector<double> y_analytic(y, y + Model::var_size * size);
+
+	computeJac();
+	computeSparseJac();
+
+	double a_max = 0.0, a_err = 0.0;
+	for (int k = 0; k < elemNum; k++)
+	{
+		a_max = std::max(a_max, fabs(a[k]));
+		a_err = std::max(a_err, fabs(a[k] - a_analytic[k]));
+	}
+	double y_max = 0.0, y_err = 0.0;
+	for (int i = 0; i < Model::var_size * size; i++)
+	{
+		y_max = std::max(y_max, fabs(y[i]));
+		y_err = std::max(y_err, fabs(y[i] - y_analytic[i]));
+	}
+
+	return std::max(a_err / std::max(a_max, EQUALITY_TOLERANCE), y_err / std::max(y_max, EQUALITY_TOLERANCE));
 }
 void Oil2dSolver::fill()
 {
-	sparse_jac(0, Model::var_size * model->cellsNum, Model::var_size * model->cellsNum, repeat,
-		&model->u_next[0], &elemNum, (unsigned int**)(&ind_i), (unsigned int**)(&ind_j), &a, options);
+	if (JAC_TYPE == JAC_ENGINE::ADOLC)
+		computeSparseJac();
 
 	int counter = 0;
 	for (const auto& cell : mesh->cells)
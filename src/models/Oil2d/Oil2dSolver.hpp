@@ -4,6 +4,7 @@
 #include "src/models/AbstractSolver.hpp"
 #include "src/models/Oil2d/Oil2d.hpp"
 #include "src/solvers/ParalutionInterface.h"
+#include "src/solvers/BlockSolver.hpp"
 #include <fstream>
 
 namespace oil2d
@@ -17,10 +18,29 @@ namespace oil2d
 
 		std::ofstream plot_P, plot_Q;
 		ParSolver solver;
+		BlockSolver<var_size> blockSolver;
+		// Linear solver of the Newton iterations
+		LIN_SOLVER SOLVER_TYPE;
 
+		void setTapeParams();
 		void computeJac();
 		void fill();
-		void copySolution(const paralution::LocalVector<double>& sol);
+
+		// Way to compute the Jacobian
+		JAC_ENGINE JAC_TYPE;
+		// If true the Jacobian is compared with ADOL-C one at the first iteration
+		bool CHECK_JAC;
+		bool isJacChecked;
+		std::vector<double> jacRow;
+		void computeJacAnalytic();
+		double checkJac();
+
+		template <class TState>
+		typename TState::Scalar solveCell(const Cell& cell, const TState& st) const;
+		void computeJacDual();
+		void computeResidual();
+		template <class TVector>
+		void copySolution(const TVector& sol);
 	public:
 		Oil2dSolver(Model* _model);
 		~Oil2dSolver();
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <utility>
+#include <cmath>
 
 #include "adolc/adouble.h"
 #include "adolc/taping.h"
@@ -21,13 +22,23 @@ namespace oil2d
 		double p_init;
 		double p_out;
 
-		inline adouble getPoro(adouble p) const
+		template <typename T>
+		inline T getPoro(const T& p) const
 		{
-			return (adouble)(m)* ((adouble)(1.0) + (adouble)(beta)* (p - p_init));
+			return m * (1.0 + beta * (p - p_init));
 		};
-		inline adouble getDensity(adouble p) const
+		template <typename T>
+		inline T getDensity(const T& p) const
 		{
-			return (adouble)(dens_stc);
+			return dens_stc;
+		};
+		inline double getPoro_value(const double p) const
+		{
+			return m * (1.0 + beta * (p - p_init));
+		};
+		inline double getPoro_dp(const double p) const
+		{
+			return m * beta;
 		};
 	};
 	struct Oil_Props
@@ -37,17 +48,36 @@ namespace oil2d
 		double beta;
 
 		double p_ref;
-		inline adouble getB(adouble p) const
+		template <typename T>
+		inline T getB(const T& p) const
 		{
-			return exp(-(adouble)beta * (p - p_ref));
+			return exp(-beta * (p - p_ref));
 		};
-		inline adouble getDensity(adouble p) const
+		template <typename T>
+		inline T getDensity(const T& p) const
 		{
 			return dens_stc / getB(p);
 		};
-		inline adouble getViscosity(const adouble p) const
+		template <typename T>
+		inline T getViscosity(const T& p) const
+		{
+			return visc;
+		};
+		inline double getDensity_value(const double p) const
+		{
+			return dens_stc * std::exp(beta * (p - p_ref));
+		};
+		inline double getDensity_dp(const double p) const
+		{
+			return beta * getDensity_value(p);
+		};
+		inline double getViscosity_value(const double p) const
+		{
+			return visc;
+		};
+		inline double getViscosity_dp(const double p) const
 		{
-			return (adouble)(visc);
+			return 0.0;
 		};
 	};
 	struct Properties
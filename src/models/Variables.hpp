@@ -4,68 +4,144 @@
 #include <valarray>
 #include <array>
 #include "adolc/adouble.h"
+#include "src/util/Dual.hpp"
 
 namespace var
 {
 	namespace containers
 	{
-		struct Var1phase
+		template <typename TScalar>
+		struct ScalarVar1Phase
 		{
+			typedef TScalar Scalar;
 			static const int size = 1;
-			double& p;
+			TScalar p;
 
-			Var1phase(double* data) : p(data[0]) {};
-			Var1phase(const double* data) : p(const_cast<double&>(data[0])) {};
+			TScalar& operator[](const int i) { return p; };
+			const TScalar& operator[](const int i) const { return p; };
 		};
-		struct TapeVar1Phase
-		{
-			static const int size = 1;
-			adouble p;
-		};
-		struct AcidVar
-		{
-			static const int size = 5;
-			double& m;
-			double& p;
-			double& s;
-			double& xa;
-			double& xw;
-
-			AcidVar(double* data) : m(data[0]), p(data[1]), s(data[2]), xa(data[3]), xw(data[4]) {};
-			AcidVar(const double* data) : m(const_cast<double&>(data[0])), p(const_cast<double&>(data[1])), 
-											s(const_cast<double&>(data[2])), xa(const_cast<double&>(data[3])), 
-											xw(const_cast<double&>(data[4])) {};
-		};
-		struct TapeAcidVar
+		typedef ScalarVar1Phase<double> Var1phase;
+		typedef ScalarVar1Phase<adouble> TapeVar1Phase;
+		template <typename TScalar>
+		struct ScalarAcidVar
 		{
+			typedef TScalar Scalar;
 			static const int size = 5;
-			adouble m;
-			adouble p;
-			adouble s;
-			adouble xa;
-			adouble xw;
+			TScalar m;
+			TScalar p;
+			TScalar s;
+			TScalar xa;
+			TScalar xw;
+
+			TScalar& operator[](const int i) { return (&m)[i]; };
+			const TScalar& operator[](const int i) const { return (&m)[i]; };
 		};
+		typedef ScalarAcidVar<double> AcidVar;
+		typedef ScalarAcidVar<adouble> TapeAcidVar;
 	};
 
+	// Views of the three time layers of a cell, no data is copied
 	template <typename TVariable>
 	struct BaseVarWrapper
 	{
-		TVariable u_prev, u_iter, u_next;
+		TVariable& u_prev;
+		TVariable& u_iter;
+		TVariable& u_next;
 	};
+	// Unknowns of a cell are stored together, named access to them is laid over the valarrays
 	template <typename TVariable>
 	struct BasicVariables
 	{
 		static const int size = TVariable::size;
+		static_assert(sizeof(TVariable) == size * sizeof(double), "Variable must be a plain array of doubles");
 		typedef BaseVarWrapper<TVariable> Wrap;
+		typedef BaseVarWrapper<const TVariable> ConstWrap;
 		std::valarray<double> u_prev, u_iter, u_next;
 
-		Wrap operator[](const size_t idx)
+		inline Wrap operator[](const size_t idx)
+		{
+			return{ at(u_prev, idx), at(u_iter, idx), at(u_next, idx) };
+		};
+		inline ConstWrap operator[](const size_t idx) const
+		{
+			return{ at(u_prev, idx), at(u_iter, idx), at(u_next, idx) };
+		};
+	protected:
+		static inline TVariable& at(std::valarray<double>& u, const size_t idx)
 		{
-			return{ TVariable(&u_prev[idx * size]), TVariable(&u_iter[idx * size]), TVariable(&u_next[idx * size]) };
+			return reinterpret_cast<TVariable&>(u[idx * size]);
 		};
-		Wrap operator[](const size_t idx) const
+		static inline const TVariable& at(const std::valarray<double>& u, const size_t idx)
 		{
-			return{ TVariable(&u_prev[idx * size]), TVariable(&u_iter[idx * size]), TVariable(&u_next[idx * size]) };
+			return reinterpret_cast<const TVariable&>(u[idx * size]);
+		};
+	};
+
+	// Unknowns seen by the templated residual kernels
+	// Variables and parameters recorded on the ADOL-C tape
+	template <class TVar>
+	struct TapeState
+	{
+		typedef TVar Variable;
+		typedef typename TVar::Scalar Scalar;
+
+		const TVar* x;
+		const TVar* x_prev;
+		const adouble& ht;
+
+		const TVar& operator[](const size_t idx) const { return x[idx]; };
+		const TVar& prev(const size_t idx) const { return x_prev[idx]; };
+	};
+	// Plain values laid over the valarrays of the model, used for residual-only evaluation
+	template <template <typename> class TScalarVar>
+	struct ValueState
+	{
+		typedef TScalarVar<double> Variable;
+		typedef double Scalar;
+		static_assert(sizeof(Variable) == Variable::size * sizeof(double), "Variable must be a plain array of doubles");
+
+		const Variable* x;
+		const Variable* x_prev;
+		double ht;
+
+		ValueState(const std::valarray<double>& u_next, const std::valarray<double>& u_prev, const double _ht) :
+			x(reinterpret_cast<const Variable*>(&u_next[0])), x_prev(reinterpret_cast<const Variable*>(&u_prev[0])), ht(_ht) {};
+
+		const Variable& operator[](const size_t idx) const { return x[idx]; };
+		const Variable& prev(const size_t idx) const { return x_prev[idx]; };
+	};
+	// Dual numbers of width N, unknowns of the seeded cells are independent, the others are constants
+	template <template <typename> class TScalarVar, int N>
+	struct DualState : public ValueState<TScalarVar>
+	{
+		typedef Dual<N> Scalar;
+		typedef TScalarVar<Scalar> Variable;
+		typedef TScalarVar<double> ValueVariable;
+		static const int cellsMax = N / ValueVariable::size;
+
+		int seededNum;
+		int seeded[cellsMax];
+
+		DualState(const std::valarray<double>& u_next, const std::valarray<double>& u_prev, const double _ht) :
+			ValueState<TScalarVar>(u_next, u_prev, _ht), seededNum(0) {};
+
+		void seed(const int* ids, const int num)
+		{
+			seededNum = num;
+			for (int k = 0; k < num; k++)
+				seeded[k] = ids[k];
+		};
+		Variable operator[](const size_t idx) const
+		{
+			int k = 0;
+			while (k < seededNum && seeded[k] != idx)
+				k++;
+
+			Variable res;
+			const ValueVariable& var = this->x[idx];
+			for (int j = 0; j < ValueVariable::size; j++)
+				res[j] = (k < seededNum) ? Scalar(var[j], ValueVariable::size * k + j) : Scalar(var[j]);
+			return res;
 		};
 	};
 }
@@ -23,6 +23,50 @@ VTKSnapshotter<modelType>::VTKSnapshotter(const modelType* _model) : model(_mode
 {
 	pattern = prefix + "CGAL_First_%{STEP}.vtu";
 
+	MIRROR = true;
+	setImages();
+}
+template<class modelType>
+void VTKSnapshotter<modelType>::setImages()
+{
+	images.assign(1, { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 });
+	if (!MIRROR)
+		return;
+
+	// Reflections by the symmetry lines
+	vector<std::array<double, 6>> refls;
+	for (const auto& line : mesh->symmetryPlanes)
+	{
+		const double dx = line.second[0] - line.first[0], dy = line.second[1] - line.first[1];
+		const double len = sqrt(dx * dx + dy * dy);
+		const double cx = dx / len, cy = dy / len;
+		const double a11 = 2.0 * cx * cx - 1.0, a12 = 2.0 * cx * cy, a22 = 2.0 * cy * cy - 1.0;
+		refls.push_back({ a11, a12, a12, a22,
+						line.first[0] - a11 * line.first[0] - a12 * line.first[1],
+						line.first[1] - a12 * line.first[0] - a22 * line.first[1] });
+	}
+
+	// Group generated by the reflections, planes at the angle pi / n give 2n copies
+	const size_t IMAGES_MAX = 64;
+	for (size_t k = 0; k < images.size() && images.size() < IMAGES_MAX; k++)
+		for (const auto& r : refls)
+		{
+			const auto t = images[k];
+			const std::array<double, 6> img = { r[0] * t[0] + r[1] * t[2], r[0] * t[1] + r[1] * t[3],
+												r[2] * t[0] + r[3] * t[2], r[2] * t[1] + r[3] * t[3],
+												r[0] * t[4] + r[1] * t[5] + r[4], r[2] * t[4] + r[3] * t[5] + r[5] };
+			bool isNew = true;
+			for (const auto& other : images)
+			{
+				double diff = 0.0;
+				for (int i = 0; i < 6; i++)
+					diff = std::max(diff, fabs(img[i] - other[i]));
+				if (diff < 1.E-8)
+					isNew = false;
+			}
+			if (isNew)
+				images.push_back(img);
+		}
 }
 template<class modelType>
 VTKSnapshotter<modelType>::~VTKSnapshotter()
@@ -70,30 +114,32 @@ void VTKSnapshotter<oil2d::Oil2d>::dump(const int i)
 	auto perm_y = vtkSmartPointer<vtkDoubleArray>::New();
 	perm_y->SetName("k_y");
 
-	points->Allocate(mesh->getVerticesSize());
-	facets->Allocate(mesh->getCellsSize());
+	points->Allocate(images.size() * mesh->getVerticesSize());
+	facets->Allocate(images.size() * mesh->getCellsSize());
 
-	for (const auto& vhandle : mesh->vertexHandles)
-	{
-		const auto& pt = vhandle->point();
-		points->InsertNextPoint(pt[0] * model->R_dim, pt[1] * model->R_dim, 0.0);
-	}
-	for (int i = 0; i < mesh->inner_cells; i++) 
+	for (const auto& img : images)
+		for (const auto& pt : mesh->vertices)
+			points->InsertNextPoint((img[0] * pt.x + img[1] * pt.y + img[4]) * model->R_dim,
+									(img[2] * pt.x + img[3] * pt.y + img[5]) * model->R_dim, 0.0);
+	for (size_t img = 0; img < images.size(); img++)
 	{
-		const Cell& cell = mesh->cells[i];
-		auto vtkCell = vtkSmartPointer<vtkTriangle>::New();
-
-		for (int i = 0; i < Mesh::CELL_POINTS_NUMBER; i++) 
-			vtkCell->GetPointIds()->SetId(i, cell.points[i]);
-
-		facets->InsertNextCell(vtkCell);
-		type->InsertNextValue(cell.type);
-		vol->InsertNextValue(cell.V);
-		id->InsertNextValue(cell.id);
-		const auto& var = (*model)[i].u_next;
-		pres->InsertNextValue(var.p * model->P_dim / BAR_TO_PA);
-		perm_x->InsertNextValue(model->getPerm(cell) * model->R_dim * model->R_dim);
-		perm_y->InsertNextValue(model->getPerm(cell) * model->R_dim * model->R_dim);
+		for (int i = 0; i < mesh->inner_cells; i++) 
+		{
+			const Cell& cell = mesh->cells[i];
+			auto vtkCell = vtkSmartPointer<vtkTriangle>::New();
+
+			for (int i = 0; i < Mesh::CELL_POINTS_NUMBER; i++) 
+				vtkCell->GetPointIds()->SetId(i, img * mesh->getVerticesSize() + cell.points[i]);
+
+			facets->InsertNextCell(vtkCell);
+			type->InsertNextValue(cell.type);
+			vol->InsertNextValue(cell.V);
+			id->InsertNextValue(cell.id);
+			const auto& var = (*model)[i].u_next;
+			pres->InsertNextValue(var.p * model->P_dim / BAR_TO_PA);
+			perm_x->InsertNextValue(model->getPerm(cell) * model->R_dim * model->R_dim);
+			perm_y->InsertNextValue(model->getPerm(cell) * model->R_dim * model->R_dim);
+		}
 	}
 
 	grid->SetPoints(points);
@@ -140,34 +186,36 @@ void VTKSnapshotter<acid2d::Acid2d>::dump(const int i)
 	auto perm_y = vtkSmartPointer<vtkDoubleArray>::New();
 	perm_y->SetName("k_y");
 
-	points->Allocate(mesh->getVerticesSize());
-	facets->Allocate(mesh->getCellsSize());
+	points->Allocate(images.size() * mesh->getVerticesSize());
+	facets->Allocate(images.size() * mesh->getCellsSize());
 
-	for (const auto& vhandle : mesh->vertexHandles)
-	{
-		const auto& pt = vhandle->point();
-		points->InsertNextPoint(pt[0] * model->R_dim, pt[1] * model->R_dim, 0.0);
-	}
-	for (int i = 0; i < mesh->inner_cells; i++)
+	for (const auto& img : images)
+		for (const auto& pt : mesh->vertices)
+			points->InsertNextPoint((img[0] * pt.x + img[1] * pt.y + img[4]) * model->R_dim,
+									(img[2] * pt.x + img[3] * pt.y + img[5]) * model->R_dim, 0.0);
+	for (size_t img = 0; img < images.size(); img++)
 	{
-		const Cell& cell = mesh->cells[i];
-		auto vtkCell = vtkSmartPointer<vtkTriangle>::New();
-
-		for (int i = 0; i < Mesh::CELL_POINTS_NUMBER; i++)
-			vtkCell->GetPointIds()->SetId(i, cell.points[i]);
-
-		facets->InsertNextCell(vtkCell);
-		type->InsertNextValue(cell.type);
-		const auto& var = (*model)[i].u_next;
-		poro->InsertNextValue(var.m);
-		pres->InsertNextValue(var.p * model->P_dim / BAR_TO_PA);
-		s_wat->InsertNextValue(var.s);
-		s_oil->InsertNextValue(1.0 - var.s);
-		xa->InsertNextValue(var.xa);
-		xw->InsertNextValue(var.xw);
-		xs->InsertNextValue(1.0 - var.xa - var.xw);
-		perm_x->InsertNextValue(M2toMilliDarcy(model->getPermValue(cell) * model->R_dim * model->R_dim));
-		perm_y->InsertNextValue(M2toMilliDarcy(model->getPerm(cell).value() * model->R_dim * model->R_dim));
+		for (int i = 0; i < mesh->inner_cells; i++)
+		{
+			const Cell& cell = mesh->cells[i];
+			auto vtkCell = vtkSmartPointer<vtkTriangle>::New();
+
+			for (int i = 0; i < Mesh::CELL_POINTS_NUMBER; i++)
+				vtkCell->GetPointIds()->SetId(i, img * mesh->getVerticesSize() + cell.points[i]);
+
+			facets->InsertNextCell(vtkCell);
+			type->InsertNextValue(cell.type);
+			const auto& var = (*model)[i].u_next;
+			poro->InsertNextValue(var.m);
+			pres->InsertNextValue(var.p * model->P_dim / BAR_TO_PA);
+			s_wat->InsertNextValue(var.s);
+			s_oil->InsertNextValue(1.0 - var.s);
+			xa->InsertNextValue(var.xa);
+			xw->InsertNextValue(var.xw);
+			xs->InsertNextValue(1.0 - var.xa - var.xw);
+			perm_x->InsertNextValue(M2toMilliDarcy(model->getPermValue(cell) * model->R_dim * model->R_dim));
+			perm_y->InsertNextValue(M2toMilliDarcy(model->getPerm(cell).value() * model->R_dim * model->R_dim));
+		}
 	}
 
 	grid->SetPoints(points);
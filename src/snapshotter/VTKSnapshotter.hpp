@@ -3,6 +3,8 @@
 
 #include <string>
 #include <memory>
+#include <array>
+#include <vector>
 
 template<class modelType>
 class VTKSnapshotter
@@ -18,6 +20,12 @@ private:
 	const Model* model;
 	const Mesh* mesh;
 
+	// If true the sector is reflected by the symmetry planes to show the full domain
+	bool MIRROR;
+	// Affine maps x' = A x + b of the sector copies stored as { a11, a12, a21, a22, b1, b2 }
+	std::vector<std::array<double, 6>> images;
+	void setImages();
+
 	std::string replace(std::string filename, std::string from, std::string to);
 	std::string getFileName(int i);
 public:
@@ -0,0 +1,314 @@
+#include "src/solvers/BlockSolver.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+template <int N>
+BlockSolver<N>::BlockSolver()
+{
+	blocksNum = 0;
+	isAssembled = false;
+	itersNum = 0;
+	finalRes = 0.0;
+	isConverged = false;
+	forcedRelTol = 0.0;
+
+	REL_TOL = 1.E-12;
+	MAX_ITERS = 1000;
+}
+template <int N>
+BlockSolver<N>::~BlockSolver()
+{
+}
+template <int N>
+void BlockSolver<N>::Init(const int _blocksNum)
+{
+	blocksNum = _blocksNum;
+	const int n = N * blocksNum;
+	rhs.resize(n);
+	x.resize(n);
+	diagInv.resize(block_size * blocksNum);
+	r.resize(n);	r0.resize(n);	p.resize(n);	v.resize(n);
+	s.resize(n);	t.resize(n);	y.resize(n);	z.resize(n);
+	isAssembled = false;
+}
+template <int N>
+void BlockSolver<N>::buildStructure(const int* rowPtr, const int* ind_j)
+{
+	offsets.assign(1, 0);
+	cols.clear();
+	diag.resize(blocksNum);
+	for (int i = 0; i < blocksNum; i++)
+	{
+		const int first = rowPtr[N * i];
+		const int num = (rowPtr[N * i + 1] - first) / N;
+		for (int k = 0; k < num; k++)
+		{
+			const int j = ind_j[first + N * k] / N;
+			if (j == i)
+				diag[i] = cols.size();
+			cols.push_back(j);
+		}
+		offsets.push_back(cols.size());
+	}
+	vals.resize(block_size * cols.size());
+	lu.resize(vals.size());
+	isAssembled = true;
+}
+template <int N>
+void BlockSolver<N>::Assemble(const int* rowPtr, const int* ind_j, const double* a, const double* _rhs)
+{
+	if (!isAssembled || rowPtr[N * blocksNum] != (int)vals.size())
+		buildStructure(rowPtr, ind_j);
+
+	// Rows of the block are scattered over N scalar CSR rows
+	for (int i = 0; i < blocksNum; i++)
+		for (int row = 0; row < N; row++)
+		{
+			const double* src = a + rowPtr[N * i + row];
+			for (int idx = offsets[i]; idx < offsets[i + 1]; idx++)
+			{
+				double* dst = &vals[block_size * idx + N * row];
+				const double* src_block = src + N * (idx - offsets[i]);
+				for (int c = 0; c < N; c++)
+					dst[c] = src_block[c];
+			}
+		}
+
+	std::copy(_rhs, _rhs + N * blocksNum, rhs.begin());
+}
+template <int N>
+inline void BlockSolver<N>::mult(const double* block, const double* v, double* res)
+{
+	for (int r = 0; r < N; r++)
+	{
+		double sum = 0.0;
+		for (int c = 0; c < N; c++)
+			sum += block[N * r + c] * v[c];
+		res[r] = sum;
+	}
+}
+template <int N>
+inline void BlockSolver<N>::multSub(const double* block, const double* v, double* res)
+{
+	for (int r = 0; r < N; r++)
+	{
+		double sum = 0.0;
+		for (int c = 0; c < N; c++)
+			sum += block[N * r + c] * v[c];
+		res[r] -= sum;
+	}
+}
+template <int N>
+inline void BlockSolver<N>::multBlocks(const double* b1, const double* b2, double* res)
+{
+	for (int r = 0; r < N; r++)
+		for (int c = 0; c < N; c++)
+		{
+			double sum = 0.0;
+			for (int k = 0; k < N; k++)
+				sum += b1[N * r + k] * b2[N * k + c];
+			res[N * r + c] = sum;
+		}
+}
+template <int N>
+inline void BlockSolver<N>::multBlocksSub(const double* b1, const double* b2, double* res)
+{
+	for (int r = 0; r < N; r++)
+		for (int k = 0; k < N; k++)
+		{
+			const double f = b1[N * r + k];
+			for (int c = 0; c < N; c++)
+				res[N * r + c] -= f * b2[N * k + c];
+		}
+}
+template <int N>
+bool BlockSolver<N>::invert(const double* block, double* inv)
+{
+	// Gauss-Jordan elimination with partial pivoting
+	double tmp[block_size];
+	std::copy(block, block + block_size, tmp);
+	for (int r = 0; r < N; r++)
+		for (int c = 0; c < N; c++)
+			inv[N * r + c] = (r == c) ? 1.0 : 0.0;
+
+	for (int c = 0; c < N; c++)
+	{
+		int piv = c;
+		for (int r = c + 1; r < N; r++)
+			if (fabs(tmp[N * r + c]) > fabs(tmp[N * piv + c]))
+				piv = r;
+		if (fabs(tmp[N * piv + c]) < 1.E-300)
+			return false;
+		if (piv != c)
+			for (int k = 0; k < N; k++)
+			{
+				std::swap(tmp[N * c + k], tmp[N * piv + k]);
+				std::swap(inv[N * c + k], inv[N * piv + k]);
+			}
+
+		const double d = 1.0 / tmp[N * c + c];
+		for (int k = 0; k < N; k++)
+		{
+			tmp[N * c + k] *= d;
+			inv[N * c + k] *= d;
+		}
+		for (int r = 0; r < N; r++)
+		{
+			if (r == c)
+				continue;
+			const double f = tmp[N * r + c];
+			for (int k = 0; k < N; k++)
+			{
+				tmp[N * r + k] -= f * tmp[N * c + k];
+				inv[N * r + k] -= f * inv[N * c + k];
+			}
+		}
+	}
+	return true;
+}
+template <int N>
+void BlockSolver<N>::spmv(const double* v, double* res) const
+{
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < blocksNum; i++)
+	{
+		double sum[N];
+		for (int c = 0; c < N; c++)
+			sum[c] = 0.0;
+		for (int idx = offsets[i]; idx < offsets[i + 1]; idx++)
+		{
+			const double* block = &vals[block_size * idx];
+			const double* vj = v + N * cols[idx];
+			for (int r = 0; r < N; r++)
+				for (int c = 0; c < N; c++)
+					sum[r] += block[N * r + c] * vj[c];
+		}
+		for (int c = 0; c < N; c++)
+			res[N * i + c] = sum[c];
+	}
+}
+template <int N>
+void BlockSolver<N>::factorize()
+{
+	lu = vals;
+	std::vector<int> pos(blocksNum, -1);
+	double tmp[block_size];
+	for (int i = 0; i < blocksNum; i++)
+	{
+		for (int idx = offsets[i]; idx < offsets[i + 1]; idx++)
+			pos[cols[idx]] = idx;
+
+		// L_ij = A_ij * U_jj^-1, then the rest of the row is updated by the row j of U
+		for (int idx = offsets[i]; idx < diag[i]; idx++)
+		{
+			const int j = cols[idx];
+			double* l = &lu[block_size * idx];
+			multBlocks(l, &diagInv[block_size * j], tmp);
+			std::copy(tmp, tmp + block_size, l);
+			for (int jdx = diag[j] + 1; jdx < offsets[j + 1]; jdx++)
+				if (pos[cols[jdx]] >= 0)
+					multBlocksSub(l, &lu[block_size * jdx], &lu[block_size * pos[cols[jdx]]]);
+		}
+
+		// Singular pivot block is replaced by the identity to keep the preconditioner defined
+		double* inv = &diagInv[block_size * i];
+		if (!invert(&lu[block_size * diag[i]], inv))
+			for (int r = 0; r < N; r++)
+				for (int c = 0; c < N; c++)
+					inv[N * r + c] = (r == c) ? 1.0 : 0.0;
+
+		for (int idx = offsets[i]; idx < offsets[i + 1]; idx++)
+			pos[cols[idx]] = -1;
+	}
+}
+template <int N>
+void BlockSolver<N>::applyPrecond(const double* r, double* z) const
+{
+	// Forward substitution with unit diagonal blocks of L
+	for (int i = 0; i < blocksNum; i++)
+	{
+		double* zi = z + N * i;
+		for (int c = 0; c < N; c++)
+			zi[c] = r[N * i + c];
+		for (int idx = offsets[i]; idx < diag[i]; idx++)
+			multSub(&lu[block_size * idx], z + N * cols[idx], zi);
+	}
+	// Backward substitution with U
+	double tmp[N];
+	for (int i = blocksNum - 1; i >= 0; i--)
+	{
+		double* zi = z + N * i;
+		for (int c = 0; c < N; c++)
+			tmp[c] = zi[c];
+		for (int idx = diag[i] + 1; idx < offsets[i + 1]; idx++)
+			multSub(&lu[block_size * idx], z + N * cols[idx], tmp);
+		mult(&diagInv[block_size * i], tmp, zi);
+	}
+}
+template <int N>
+void BlockSolver<N>::Solve()
+{
+	const int n = N * blocksNum;
+	auto dot = [n](const std::vector<double>& a, const std::vector<double>& b)
+	{
+		return std::inner_product(a.begin(), a.begin() + n, b.begin(), 0.0);
+	};
+
+	factorize();
+
+	std::fill(x.begin(), x.end(), 0.0);
+	std::fill(p.begin(), p.end(), 0.0);
+	std::fill(v.begin(), v.end(), 0.0);
+	r = rhs;
+	r0 = r;
+	const double norm_b = sqrt(dot(rhs, rhs));
+	const double tol = ((forcedRelTol > 0.0) ? forcedRelTol : REL_TOL) * norm_b;
+	double rho = 1.0, alpha = 1.0, omega = 1.0;
+
+	itersNum = 0;
+	finalRes = norm_b;
+	isConverged = (norm_b == 0.0);
+	while (!isConverged && itersNum < MAX_ITERS)
+	{
+		itersNum++;
+		const double rho_new = dot(r0, r);
+		if (rho_new == 0.0)
+			break;
+
+		const double beta = (rho_new / rho) * (alpha / omega);
+		for (int i = 0; i < n; i++)
+			p[i] = r[i] + beta * (p[i] - omega * v[i]);
+		applyPrecond(&p[0], &y[0]);
+		spmv(&y[0], &v[0]);
+		alpha = rho_new / dot(r0, v);
+		for (int i = 0; i < n; i++)
+			s[i] = r[i] - alpha * v[i];
+
+		finalRes = sqrt(dot(s, s));
+		if (finalRes < tol)
+		{
+			for (int i = 0; i < n; i++)
+				x[i] += alpha * y[i];
+			isConverged = true;
+			break;
+		}
+
+		applyPrecond(&s[0], &z[0]);
+		spmv(&z[0], &t[0]);
+		omega = dot(t, s) / dot(t, t);
+		for (int i = 0; i < n; i++)
+		{
+			x[i] += alpha * y[i] + omega * z[i];
+			r[i] = s[i] - omega * t[i];
+		}
+		rho = rho_new;
+
+		finalRes = sqrt(dot(r, r));
+		isConverged = (finalRes < tol);
+	}
+}
+
+template class BlockSolver<1>;
+template class BlockSolver<5>;
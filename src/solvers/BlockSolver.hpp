@@ -0,0 +1,62 @@
+#ifndef BLOCKSOLVER_HPP_
+#define BLOCKSOLVER_HPP_
+
+#include <vector>
+
+// Native block-CSR storage of the Jacobian with dense N x N blocks for each pair of connected cells
+// System is solved by BiCGStab with block ILU(0) preconditioning
+template <int N>
+class BlockSolver
+{
+public:
+	static const int block_size = N * N;
+protected:
+	int blocksNum;
+	// Block CSR structure, columns inside the block row are sorted
+	std::vector<int> offsets, cols;
+	// Position of the diagonal block in each block row
+	std::vector<int> diag;
+	std::vector<double> vals, rhs, x;
+	bool isAssembled;
+	void buildStructure(const int* rowPtr, const int* ind_j);
+
+	// Block ILU(0) factors stored in the BCSR pattern with inverted diagonal blocks
+	std::vector<double> lu, diagInv;
+	void factorize();
+	void applyPrecond(const double* r, double* z) const;
+
+	// Block kernels
+	static inline void mult(const double* block, const double* v, double* res);
+	static inline void multSub(const double* block, const double* v, double* res);
+	static inline void multBlocks(const double* b1, const double* b2, double* res);
+	static inline void multBlocksSub(const double* b1, const double* b2, double* res);
+	static bool invert(const double* block, double* inv);
+	void spmv(const double* v, double* res) const;
+
+	// BiCGStab work vectors
+	std::vector<double> r, r0, p, v, s, t, y, z;
+	int itersNum;
+	double finalRes;
+	bool isConverged;
+	// Relative tolerance set by the nonlinear solver, zero keeps REL_TOL
+	double forcedRelTol;
+public:
+	double REL_TOL;
+	int MAX_ITERS;
+
+	BlockSolver();
+	~BlockSolver();
+
+	void Init(const int _blocksNum);
+	// Values are taken from the scalar CSR with dense blocks produced by AbstractSolver::fillIndices
+	void Assemble(const int* rowPtr, const int* ind_j, const double* a, const double* _rhs);
+	void Solve();
+	// Relative tolerance of the next solves, zero restores REL_TOL
+	void SetRelTolerance(const double relTol) { forcedRelTol = relTol; };
+
+	const std::vector<double>& getSolution() const { return x; };
+	int getIterations() const { return itersNum; };
+	bool getConverged() const { return isConverged; };
+};
+
+#endif /* BLOCKSOLVER_HPP_ */
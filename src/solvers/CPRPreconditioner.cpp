@@ -0,0 +1,231 @@
+#include "src/solvers/CPRPreconditioner.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+using std::cout;
+using std::endl;
+
+CPRPreconditioner::CPRPreconditioner()
+{
+	blockSize = 1;
+	presIdx = 0;
+	cellsNum = 0;
+
+	PRES_ITERS = 2;
+	PRES_TOL = 1.E-2;
+}
+CPRPreconditioner::~CPRPreconditioner()
+{
+	Clear();
+}
+void CPRPreconditioner::Set(const int _blockSize, const int _presIdx)
+{
+	blockSize = _blockSize;
+	presIdx = _presIdx;
+}
+void CPRPreconditioner::Print() const
+{
+	cout << "CPR preconditioner: AMG for pressure, ILU(0) for the whole system, block size = " << blockSize << endl;
+}
+void CPRPreconditioner::computeWeights(const int* offsets, const int* cols, const double* vals)
+{
+	const int bs = blockSize;
+	weights.assign(bs * cellsNum, 0.0);
+	std::vector<double> d(bs * bs), w(bs);
+
+	for (int i = 0; i < cellsNum; i++)
+	{
+		// Transposed diagonal block of the cell
+		std::fill(d.begin(), d.end(), 0.0);
+		for (int k = 0; k < bs; k++)
+		{
+			const int row = bs * i + k;
+			for (int idx = offsets[row]; idx < offsets[row + 1]; idx++)
+				if (cols[idx] / bs == i)
+					d[(cols[idx] % bs) * bs + k] = vals[idx];
+		}
+		std::fill(w.begin(), w.end(), 0.0);
+		w[presIdx] = 1.0;
+
+		// Gaussian elimination with partial pivoting for D^T w = e_p
+		bool isSingular = false;
+		for (int c = 0; c < bs && !isSingular; c++)
+		{
+			int piv = c;
+			for (int r = c + 1; r < bs; r++)
+				if (fabs(d[r * bs + c]) > fabs(d[piv * bs + c]))
+					piv = r;
+			if (fabs(d[piv * bs + c]) < 1.E-300)
+			{
+				isSingular = true;
+				break;
+			}
+			if (piv != c)
+			{
+				for (int k = 0; k < bs; k++)
+					std::swap(d[c * bs + k], d[piv * bs + k]);
+				std::swap(w[c], w[piv]);
+			}
+			for (int r = c + 1; r < bs; r++)
+			{
+				const double f = d[r * bs + c] / d[c * bs + c];
+				for (int k = c; k < bs; k++)
+					d[r * bs + k] -= f * d[c * bs + k];
+				w[r] -= f * w[c];
+			}
+		}
+
+		if (isSingular)
+			weights[bs * i + presIdx] = 1.0;
+		else
+			for (int r = bs - 1; r >= 0; r--)
+			{
+				double sum = w[r];
+				for (int k = r + 1; k < bs; k++)
+					sum -= d[r * bs + k] * weights[bs * i + k];
+				weights[bs * i + r] = sum / d[r * bs + r];
+			}
+	}
+}
+void CPRPreconditioner::buildPressureMatrix(const int* offsets, const int* cols, const double* vals)
+{
+	const int bs = blockSize;
+	presOffsets.assign(cellsNum + 1, 0);
+	presCols.clear();
+	presVals.clear();
+	std::vector<int> pos(cellsNum, -1);
+
+	for (int i = 0; i < cellsNum; i++)
+	{
+		const int start = presCols.size();
+		for (int k = 0; k < bs; k++)
+		{
+			const int row = bs * i + k;
+			const double w = weights[row];
+			for (int idx = offsets[row]; idx < offsets[row + 1]; idx++)
+			{
+				if (cols[idx] % bs != presIdx)
+					continue;
+
+				const int j = cols[idx] / bs;
+				if (pos[j] < start)
+				{
+					pos[j] = presCols.size();
+					presCols.push_back(j);
+					presVals.push_back(0.0);
+				}
+				presVals[pos[j]] += w * vals[idx];
+			}
+		}
+
+		// Columns of the row are kept sorted
+		for (int a = start + 1; a < (int)presCols.size(); a++)
+			for (int b = a; b > start && presCols[b - 1] > presCols[b]; b--)
+			{
+				std::swap(presCols[b - 1], presCols[b]);
+				std::swap(presVals[b - 1], presVals[b]);
+			}
+		presOffsets[i + 1] = presCols.size();
+	}
+}
+void CPRPreconditioner::Build()
+{
+	if (this->build_)
+		Clear();
+
+	const int size = this->op_->get_nrow();
+	const int nnz = this->op_->get_nnz();
+	cellsNum = size / blockSize;
+
+	std::vector<int> offsets(size + 1), cols(nnz);
+	std::vector<double> vals(nnz);
+	this->op_->CopyToCSR(&offsets[0], &cols[0], &vals[0]);
+
+	computeWeights(&offsets[0], &cols[0], &vals[0]);
+	buildPressureMatrix(&offsets[0], &cols[0], &vals[0]);
+
+	presMat.AllocateCSR("pressure", presCols.size(), cellsNum, cellsNum);
+	presMat.CopyFromCSR(&presOffsets[0], &presCols[0], &presVals[0]);
+
+	amg.SetOperator(presMat);
+	amg.Verbose(0);
+	amg.Build();
+	amg.Init(1.E-30, PRES_TOL, 1E+12, PRES_ITERS);
+
+	ilu.SetOperator(*this->op_);
+	ilu.Set(0);
+	ilu.Build();
+
+	presRhs.Allocate("pressure rhs", cellsNum);
+	presSol.Allocate("pressure sol", cellsNum);
+	res.Allocate("cpr res", size);
+	corr.Allocate("cpr corr", size);
+	buf.resize(size);
+	presBuf.resize(cellsNum);
+
+	this->build_ = true;
+}
+void CPRPreconditioner::Clear()
+{
+	amg.Clear();
+	ilu.Clear();
+	presMat.Clear();
+	presRhs.Clear();
+	presSol.Clear();
+	res.Clear();
+	corr.Clear();
+
+	this->build_ = false;
+}
+void CPRPreconditioner::Solve(const Vector& rhs, Vector* x)
+{
+	const int bs = blockSize;
+
+	// Stage 1: decoupled pressure residual is solved with AMG
+	rhs.CopyToData(&buf[0]);
+	for (int i = 0; i < cellsNum; i++)
+	{
+		double sum = 0.0;
+		for (int k = 0; k < bs; k++)
+			sum += weights[bs * i + k] * buf[bs * i + k];
+		presBuf[i] = sum;
+	}
+	presRhs.CopyFromData(&presBuf[0]);
+	presSol.Zeros();
+	amg.Solve(presRhs, &presSol);
+
+	presSol.CopyToData(&presBuf[0]);
+	std::fill(buf.begin(), buf.end(), 0.0);
+	for (int i = 0; i < cellsNum; i++)
+		buf[bs * i + presIdx] = presBuf[i];
+	x->CopyFromData(&buf[0]);
+
+	// Stage 2: ILU(0) on the residual left after the pressure correction
+	this->op_->Apply(*x, &res);
+	res.ScaleAdd(-1.0, rhs);
+	corr.Zeros();
+	ilu.Solve(res, &corr);
+	x->AddScale(corr, 1.0);
+}
+void CPRPreconditioner::MoveToHostLocalData_()
+{
+	presMat.MoveToHost();
+	presRhs.MoveToHost();
+	presSol.MoveToHost();
+	res.MoveToHost();
+	corr.MoveToHost();
+	amg.MoveToHost();
+	ilu.MoveToHost();
+}
+void CPRPreconditioner::MoveToAcceleratorLocalData_()
+{
+	presMat.MoveToAccelerator();
+	presRhs.MoveToAccelerator();
+	presSol.MoveToAccelerator();
+	res.MoveToAccelerator();
+	corr.MoveToAccelerator();
+	amg.MoveToAccelerator();
+	ilu.MoveToAccelerator();
+}
@@ -0,0 +1,53 @@
+#ifndef CPRPRECONDITIONER_H_
+#define CPRPRECONDITIONER_H_
+
+#include <vector>
+
+#include "paralution.hpp"
+
+// Two-stage constrained pressure residual preconditioner for the systems with several unknowns per cell
+// Stage 1 solves the decoupled pressure system with AMG, stage 2 smooths the whole residual with ILU(0)
+class CPRPreconditioner : public paralution::Preconditioner<paralution::LocalMatrix<double>, paralution::LocalVector<double>, double>
+{
+public:
+	typedef paralution::LocalMatrix<double> Matrix;
+	typedef paralution::LocalVector<double> Vector;
+protected:
+	int blockSize;
+	int presIdx;
+	int cellsNum;
+
+	// Quasi-IMPES weights: pressure row of the inverted diagonal block of each cell
+	std::vector<double> weights;
+	void computeWeights(const int* offsets, const int* cols, const double* vals);
+
+	// Pressure matrix in CSR
+	std::vector<int> presOffsets, presCols;
+	std::vector<double> presVals;
+	void buildPressureMatrix(const int* offsets, const int* cols, const double* vals);
+
+	Matrix presMat;
+	paralution::AMG<Matrix, Vector, double> amg;
+	paralution::ILU<Matrix, Vector, double> ilu;
+	Vector presRhs, presSol, res, corr;
+	std::vector<double> buf, presBuf;
+
+	void MoveToHostLocalData_();
+	void MoveToAcceleratorLocalData_();
+public:
+	// Number of AMG cycles applied to the pressure system
+	int PRES_ITERS;
+	// Relative tolerance of the pressure solve
+	double PRES_TOL;
+
+	CPRPreconditioner();
+	~CPRPreconditioner();
+
+	void Set(const int _blockSize, const int _presIdx);
+	void Print() const;
+	void Build();
+	void Clear();
+	void Solve(const Vector& rhs, Vector* x);
+};
+
+#endif /* CPRPRECONDITIONER_H_ */
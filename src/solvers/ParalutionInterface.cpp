@@ -2,6 +2,10 @@
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
 
 using namespace paralution;
 using std::ifstream;
@@ -12,6 +16,20 @@ ParSolver::ParSolver() : resHistoryFile("snaps/resHistory.dat")
 {
 	isAssembled = false;
 	isPrecondBuilt = false;
+	isIdentityPerm = false;
+	tripletsNum = 0;
+
+	PRECOND_REUSE_MAX = 20;
+	PRECOND_ITER_GROWTH = 1.5;
+	PRECOND_REBUILD_ON_STEP = false;
+	buildReason = FIRST;
+	solvesSinceBuild = 0;
+	itersAfterBuild = lastIters = 0.0;
+	isNewTimeStep = false;
+	std::fill_n(buildsNum, static_cast<int>(REASONS_NUM), 0);
+	reusesNum = 0;
+	forcedRelTol = 0.0;
+	krylovItersNum = 0;
 	gmres.Init(1.E-17, 1.E-12, 1E+12, 500);
 	bicgstab.Init(1.E-17, 1.E-12, 1E+12, 500);
 }
@@ -23,24 +41,92 @@ void ParSolver::Init(const int vecSize, const double relTol, const double dropTo
 	matSize = vecSize;
 	x.Allocate("x", vecSize);
 }
+void ParSolver::buildStructure(const int* ind_i, const int* ind_j, const int counter)
+{
+	tripletsNum = counter;
+	std::vector<int> order(counter);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](const int k1, const int k2)
+	{
+		return ind_i[k1] < ind_i[k2] || (ind_i[k1] == ind_i[k2] && ind_j[k1] < ind_j[k2]);
+	});
+
+	// Repeated triplets are summed up into the same element
+	rowOffsets.assign(matSize + 1, 0);
+	cols.clear();
+	perm.resize(counter);
+	for (int idx = 0; idx < counter; idx++)
+	{
+		const int k = order[idx];
+		if (idx == 0 || ind_i[k] != ind_i[order[idx - 1]] || ind_j[k] != ind_j[order[idx - 1]])
+		{
+			cols.push_back(ind_j[k]);
+			rowOffsets[ind_i[k] + 1]++;
+		}
+		perm[k] = cols.size() - 1;
+	}
+	for (int i = 0; i < matSize; i++)
+		rowOffsets[i + 1] += rowOffsets[i];
+
+	isIdentityPerm = (cols.size() == counter);
+	for (int k = 0; k < counter && isIdentityPerm; k++)
+		isIdentityPerm = (perm[k] == k);
+
+	vals.resize(cols.size());
+	rhsVals.resize(matSize);
+}
+void ParSolver::setValues(const double* a, const int* ind_rhs, const double* rhs)
+{
+	if (isIdentityPerm)
+		std::memcpy(&vals[0], a, vals.size() * sizeof(double));
+	else
+	{
+		std::fill(vals.begin(), vals.end(), 0.0);
+		for (int k = 0; k < tripletsNum; k++)
+			vals[perm[k]] += a[k];
+	}
+
+	std::fill(rhsVals.begin(), rhsVals.end(), 0.0);
+	for (int i = 0; i < matSize; i++)
+		rhsVals[ind_rhs[i]] += rhs[i];
+}
 void ParSolver::Assemble(const int* ind_i, const int* ind_j, const double* a, const int counter, const int* ind_rhs, const double* rhs)
 {
-	Mat.Zeros();
-	Rhs.Zeros();
-	x.Zeros();
+	if (isAssembled && counter == tripletsNum)
+	{
+		setValues(a, ind_rhs, rhs);
 
-	/*if (isAssembled)
+		Mat.MoveToHost();
+		Rhs.MoveToHost();
+		Mat.UpdateValuesCSR(&vals[0]);
+		Rhs.CopyFromData(&rhsVals[0]);
+	}
+	else
 	{
-		Mat.AssembleUpdate(a);
-		Rhs.Assemble(ind_rhs, rhs, matSize, "rhs");
-	} else {*/
-		Mat.Assemble(ind_i, ind_j, a, counter, "A", matSize, matSize);
-		Rhs.Assemble(ind_rhs, rhs, matSize, "rhs");
+		buildStructure(ind_i, ind_j, counter);
+		setValues(a, ind_rhs, rhs);
+
+		Mat.Clear();
+		Rhs.Clear();
+		Mat.AllocateCSR("A", cols.size(), matSize, matSize);
+		Mat.CopyFromCSR(&rowOffsets[0], &cols[0], &vals[0]);
+		Rhs.Allocate("rhs", matSize);
+		Rhs.CopyFromData(&rhsVals[0]);
+		isAssembled = true;
+
+		// Factorization of the old matrix is not applicable anymore
+		if (isPrecondBuilt)
+		{
+			clearSolvers();
+			isPrecondBuilt = false;
+			buildReason = STRUCTURE;
+		}
+	}
+	x.Zeros();
 
-		Mat.MoveToAccelerator();
-		Rhs.MoveToAccelerator();
-		x.MoveToAccelerator();
-	//}	
+	Mat.MoveToAccelerator();
+	Rhs.MoveToAccelerator();
+	x.MoveToAccelerator();
 }
 void ParSolver::Solve()
 {
@@ -51,114 +137,219 @@ void ParSolver::Solve()
 }
 void ParSolver::Solve(const PRECOND key)
 {
-	if (key == PRECOND::ILU_SERIOUS)
-		SolveBiCGStab();
-	else if (key == PRECOND::ILU_SIMPLE)
-		SolveBiCGStab_Simple();
-	else if (key == PRECOND::ILU_GMRES)
-		SolveGMRES();
-	else if (key == PRECOND::ILUT)
-		SolveBiCGStab_ILUT();
+	const auto solve = [&]()
+	{
+		if (key == PRECOND::ILU_SERIOUS)
+			SolveBiCGStab();
+		else if (key == PRECOND::ILU_SIMPLE)
+			SolveBiCGStab_Simple();
+		else if (key == PRECOND::ILU_GMRES)
+			SolveGMRES();
+		else if (key == PRECOND::ILUT)
+			SolveBiCGStab_ILUT();
+		else if (key == PRECOND::CPR)
+			SolveBiCGStab_CPR();
+	};
+
+	solve();
+	// Stale factorization may spoil the convergence, the system is solved again with the fresh one
+	if ((status == RETURN_TYPE::DIV_CRITERIA || status == RETURN_TYPE::MAX_ITER) && solvesSinceBuild > 1)
+	{
+		isPrecondBuilt = false;
+		buildReason = FAILURE;
+		x.Zeros();
+		solve();
+	}
 
 	x.MoveToHost();
 }
-void ParSolver::SolveBiCGStab_ILUT()
+void ParSolver::InitCPR(const int blockSize, const int presIdx)
+{
+	p_cpr.Set(blockSize, presIdx);
+}
+void ParSolver::InitPrecondPolicy(const int reuseMax, const double iterGrowth, const bool rebuildOnStep)
+{
+	PRECOND_REUSE_MAX = reuseMax;
+	PRECOND_ITER_GROWTH = iterGrowth;
+	PRECOND_REBUILD_ON_STEP = rebuildOnStep;
+}
+void ParSolver::NewTimeStep()
+{
+	isNewTimeStep = true;
+}
+void ParSolver::SetRelTolerance(const double relTol)
+{
+	forcedRelTol = relTol;
+}
+bool ParSolver::isRebuildNeeded(const PRECOND key)
 {
-	bicgstab.SetOperator(Mat);
-	p_ilut.Set(1.E-20, 100);
-	bicgstab.SetPreconditioner(p_ilut);
-	bicgstab.Build();
-	isAssembled = true;
+	BUILD_REASON reason;
+	if (!isPrecondBuilt)
+		reason = buildReason;
+	else if (key != builtKey)
+		reason = SOLVER;
+	else if (isNewTimeStep && PRECOND_REBUILD_ON_STEP)
+		reason = TIME_STEP;
+	else if (solvesSinceBuild >= PRECOND_REUSE_MAX)
+		reason = COUNT;
+	else if (lastIters > PRECOND_ITER_GROWTH * itersAfterBuild)
+		reason = ITERATIONS;
+	else
+	{
+		reusesNum++;
+		return false;
+	}
 
-	bicgstab.Init(1.E-20, 1.E-15, 1E+12, 1000);
+	buildsNum[reason]++;
+	return true;
+}
+void ParSolver::setBuilt(const PRECOND key)
+{
+	isPrecondBuilt = true;
+	builtKey = key;
+	solvesSinceBuild = 0;
+}
+void ParSolver::clearSolvers()
+{
+	bicgstab.Clear();
+	gmres.Clear();
+}
+template <class TSolver>
+void ParSolver::runSolver(TSolver& solver, const double relTol)
+{
 	Mat.info();
 
-	//bicgstab.RecordResidualHistory();
-	bicgstab.Solve(Rhs, &x);
-	status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
+	//solver.RecordResidualHistory();
+	solver.Solve(Rhs, &x);
+	status = static_cast<RETURN_TYPE>(solver.GetSolverStatus());
 	//if(status == RETURN_TYPE::DIV_CRITERIA || status == RETURN_TYPE::MAX_ITER)
-	//bicgstab.RecordHistory(resHistoryFile);
-	writeSystem();
+	//solver.RecordHistory(resHistoryFile);
 
-	bicgstab.Clear();
+	// Iterations are taken per decade of the residual reduction, so the solves with
+	// different forcing terms of the inexact Newton are comparable
+	const int itersNum = solver.GetIterationCount();
+	krylovItersNum += itersNum;
+	const double decades = std::max(1.0, log10(1.0 / relTol));
+	lastIters = itersNum / decades;
+	if (solvesSinceBuild == 0)
+		itersAfterBuild = std::max(itersNum, 1) / decades;
+	solvesSinceBuild++;
+	isNewTimeStep = false;
 }
-void ParSolver::SolveBiCGStab()
+void ParSolver::PrintPrecondStats() const
 {
-	bicgstab.SetOperator(Mat);
-	//p.Set(1.E-15, 100);
-	p.Set(0);
-	bicgstab.SetPreconditioner(p);
-	bicgstab.Build();
-	isAssembled = true;
+	const char* names[REASONS_NUM] = { "first", "new structure", "solver change", "reuse limit", "iterations growth", "time step", "failure" };
+	int total = 0;
+	for (int i = 0; i < REASONS_NUM; i++)
+		total += buildsNum[i];
 
-	bicgstab.Init(1.E-25, 1.E-9, 1E+12, 1000);
-	Mat.info();
+	cout << "Krylov iterations: " << krylovItersNum << endl;
+	cout << "Preconditioner builds: " << total << ", reuses: " << reusesNum << endl;
+	for (int i = 0; i < REASONS_NUM; i++)
+		if (buildsNum[i] > 0)
+			cout << "\t" << names[i] << ": " << buildsNum[i] << endl;
+}
+void ParSolver::SolveBiCGStab_ILUT()
+{
+	if (isRebuildNeeded(PRECOND::ILUT))
+	{
+		clearSolvers();
+		bicgstab.SetOperator(Mat);
+		p_ilut.Set(1.E-20, 100);
+		bicgstab.SetPreconditioner(p_ilut);
+		bicgstab.Build();
+		setBuilt(PRECOND::ILUT);
+	}
 
-	//bicgstab.RecordResidualHistory();
-	bicgstab.Solve(Rhs, &x);
-	status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
-	//if(status == RETURN_TYPE::DIV_CRITERIA || status == RETURN_TYPE::MAX_ITER)
-	//bicgstab.RecordHistory(resHistoryFile);
+	const double relTol = getRelTol(1.E-15);
+	bicgstab.Init(1.E-20, relTol, 1E+12, 1000);
+	runSolver(bicgstab, relTol);
+	writeSystem();
+}
+void ParSolver::SolveBiCGStab()
+{
+	if (isRebuildNeeded(PRECOND::ILU_SERIOUS))
+	{
+		clearSolvers();
+		bicgstab.SetOperator(Mat);
+		//p.Set(1.E-15, 100);
+		p.Set(0);
+		bicgstab.SetPreconditioner(p);
+		bicgstab.Build();
+		setBuilt(PRECOND::ILU_SERIOUS);
+	}
+
+	const double relTol = getRelTol(1.E-9);
+	bicgstab.Init(1.E-25, relTol, 1E+12, 1000);
+	runSolver(bicgstab, relTol);
 	writeSystem();
 
 	//getResiduals();
 	//cout << "Initial residual: " << initRes << endl;
 	//cout << "Final residual: " << finalRes << endl;
 	//cout << "Number of iterations: " << iterNum << endl << endl;
-
-	bicgstab.Clear();
 }
 void ParSolver::SolveBiCGStab_Simple()
 {
-	bicgstab.SetOperator(Mat);
-	//p.Set(1.E-15, 100);
-	p.Set(0);
-	bicgstab.SetPreconditioner(p);
-	bicgstab.Build();
-	isAssembled = true;
-
-	bicgstab.Init(1.E-30, 1.E-12, 1E+12, 1000);
-	Mat.info();
+	if (isRebuildNeeded(PRECOND::ILU_SIMPLE))
+	{
+		clearSolvers();
+		bicgstab.SetOperator(Mat);
+		//p.Set(1.E-15, 100);
+		p.Set(0);
+		bicgstab.SetPreconditioner(p);
+		bicgstab.Build();
+		setBuilt(PRECOND::ILU_SIMPLE);
+	}
 
-	//bicgstab.RecordResidualHistory();
-	bicgstab.Solve(Rhs, &x);
-	status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
-	//if(status == RETURN_TYPE::DIV_CRITERIA || status == RETURN_TYPE::MAX_ITER)
-	//bicgstab.RecordHistory(resHistoryFile);
+	const double relTol = getRelTol(1.E-12);
+	bicgstab.Init(1.E-30, relTol, 1E+12, 1000);
+	runSolver(bicgstab, relTol);
 	writeSystem();
 
 	//getResiduals();
 	//cout << "Initial residual: " << initRes << endl;
 	//cout << "Final residual: " << finalRes << endl;
 	//cout << "Number of iterations: " << iterNum << endl << endl;
+}
+void ParSolver::SolveBiCGStab_CPR()
+{
+	if (isRebuildNeeded(PRECOND::CPR))
+	{
+		clearSolvers();
+		bicgstab.SetOperator(Mat);
+		bicgstab.SetPreconditioner(p_cpr);
+		bicgstab.Build();
+		setBuilt(PRECOND::CPR);
+	}
 
-	bicgstab.Clear();
+	const double relTol = getRelTol(1.E-12);
+	bicgstab.Init(1.E-30, relTol, 1E+12, 1000);
+	runSolver(bicgstab, relTol);
+	writeSystem();
 }
 void ParSolver::SolveGMRES()
 {
-	gmres.SetOperator(Mat);
-	p_ilut.Set(1.E-20, 100);
-	//p.Set(3);
-	gmres.SetPreconditioner(p_ilut);
-	gmres.Build();
-	isAssembled = true;
-
-	gmres.Init(1.E-17, 1.E-12, 1E+12, 500);
-	Mat.info();
+	if (isRebuildNeeded(PRECOND::ILU_GMRES))
+	{
+		clearSolvers();
+		gmres.SetOperator(Mat);
+		p_ilut.Set(1.E-20, 100);
+		//p.Set(3);
+		gmres.SetPreconditioner(p_ilut);
+		gmres.Build();
+		setBuilt(PRECOND::ILU_GMRES);
+	}
 
-	//gmres.RecordResidualHistory();
-	gmres.Solve(Rhs, &x);
-	status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
-	//gmres.RecordHistory(resHistoryFile);
+	const double relTol = getRelTol(1.E-12);
+	gmres.Init(1.E-17, relTol, 1E+12, 500);
+	runSolver(gmres, relTol);
 	//writeSystem();
 
-
 	//getResiduals();
 	//cout << "Initial residual: " << initRes << endl;
 	//cout << "Final residual: " << finalRes << endl;
 	//cout << "Number of iterations: " << iterNum << endl << endl;
-
-	gmres.Clear();
 }
 void ParSolver::getResiduals()
 {
@@ -2,14 +2,17 @@
 #define PARALUTIONINTERFACE_H_
 
 #include <string>
+#include <vector>
 
 #include "paralution.hpp"
+#include "src/solvers/CPRPreconditioner.h"
 
-enum class PRECOND {ILU_SIMPLE, ILU_SERIOUS, ILUT, ILU_GMRES};
+enum class PRECOND {ILU_SIMPLE, ILU_SERIOUS, ILUT, ILU_GMRES, CPR};
 
 class ParSolver
 {
 	enum class RETURN_TYPE { NO_CRITERIA, ABS_CRITERION, REL_CRITERION, DIV_CRITERIA, MAX_ITER };
+	enum BUILD_REASON { FIRST, STRUCTURE, SOLVER, COUNT, ITERATIONS, TIME_STEP, FAILURE, REASONS_NUM };
 public:
 	typedef paralution::LocalMatrix<double> Matrix;
 	typedef paralution::LocalVector<double> Vector;
@@ -20,16 +23,58 @@ protected:
 	void SolveBiCGStab();
 	void SolveBiCGStab_ILUT();
 	void SolveBiCGStab_Simple();
+	void SolveBiCGStab_CPR();
 	paralution::GMRES<Matrix,Vector,double> gmres;
 	void SolveGMRES();
 	paralution::ILU<Matrix,Vector,double> p;
 	paralution::ILUT<Matrix, Vector, double> p_ilut;
+	CPRPreconditioner p_cpr;
 
 	bool isAssembled;
 	bool isPrecondBuilt;
 	int matSize;
 	RETURN_TYPE status;
 
+	// Preconditioner lifecycle
+	// Maximum number of solves with the same factorization
+	int PRECOND_REUSE_MAX;
+	// Factorization is rebuilt if iterations per decade of the requested residual reduction
+	// exceed the ones right after the build in this number of times
+	double PRECOND_ITER_GROWTH;
+	// If true the factorization is rebuilt at each new time step
+	bool PRECOND_REBUILD_ON_STEP;
+	PRECOND builtKey;
+	int solvesSinceBuild;
+	double itersAfterBuild;
+	double lastIters;
+	bool isNewTimeStep;
+	BUILD_REASON buildReason;
+	int buildsNum[REASONS_NUM];
+	int reusesNum;
+	bool isRebuildNeeded(const PRECOND key);
+	void setBuilt(const PRECOND key);
+	void clearSolvers();
+	template <class TSolver>
+	void runSolver(TSolver& solver, const double relTol);
+
+	// Relative tolerance set by the nonlinear solver, zero keeps the tolerance of each Krylov solver
+	double forcedRelTol;
+	inline double getRelTol(const double defaultTol) const
+	{
+		return (forcedRelTol > 0.0) ? forcedRelTol : defaultTol;
+	};
+	int krylovItersNum;
+
+	// CSR structure is built at the first assembly, later only values are updated
+	std::vector<int> rowOffsets, cols;
+	std::vector<double> vals, rhsVals;
+	// Position of each incoming triplet in CSR values
+	std::vector<int> perm;
+	bool isIdentityPerm;
+	int tripletsNum;
+	void buildStructure(const int* ind_i, const int* ind_j, const int counter);
+	void setValues(const double* a, const int* ind_rhs, const double* rhs);
+
 	inline void writeSystem()
 	{
 		Mat.WriteFileMTX("snaps/mat.mtx");
@@ -46,6 +91,14 @@ public:
 	void Assemble(const int* ind_i, const int* ind_j, const double* a, const int counter, const int* ind_rhs, const double* rhs);
 	void Solve();
 	void Solve(const PRECOND key);
+	// Unknowns are grouped per cell by blockSize with pressure at presIdx
+	void InitCPR(const int blockSize, const int presIdx);
+	void InitPrecondPolicy(const int reuseMax, const double iterGrowth, const bool rebuildOnStep);
+	// Notifies that the Jacobian belongs to the new time step
+	void NewTimeStep();
+	// Relative tolerance of the next solves, zero restores the tolerances of the solvers
+	void SetRelTolerance(const double relTol);
+	void PrintPrecondStats() const;
 
 	const Vector& getSolution() { return x; };
 
@@ -0,0 +1,147 @@
+#ifndef DUAL_HPP_
+#define DUAL_HPP_
+
+#include <cmath>
+
+// Forward-mode dual number with N derivative directions stored on the stack
+template <int N>
+struct Dual
+{
+	static const int width = N;
+	double val;
+	double dx[N];
+
+	Dual() : val(0.0)
+	{
+		for (int i = 0; i < N; i++)
+			dx[i] = 0.0;
+	};
+	Dual(const double value) : val(value)
+	{
+		for (int i = 0; i < N; i++)
+			dx[i] = 0.0;
+	};
+	// Independent variable with the unit derivative in direction idx
+	Dual(const double value, const int idx) : val(value)
+	{
+		for (int i = 0; i < N; i++)
+			dx[i] = 0.0;
+		dx[idx] = 1.0;
+	};
+
+	double value() const { return val; };
+
+	Dual& operator+=(const Dual& b)
+	{
+		val += b.val;
+		for (int i = 0; i < N; i++)
+			dx[i] += b.dx[i];
+		return *this;
+	};
+	Dual& operator-=(const Dual& b)
+	{
+		val -= b.val;
+		for (int i = 0; i < N; i++)
+			dx[i] -= b.dx[i];
+		return *this;
+	};
+	Dual& operator*=(const Dual& b)
+	{
+		for (int i = 0; i < N; i++)
+			dx[i] = dx[i] * b.val + val * b.dx[i];
+		val *= b.val;
+		return *this;
+	};
+	Dual& operator/=(const Dual& b)
+	{
+		const double inv = 1.0 / b.val;
+		for (int i = 0; i < N; i++)
+			dx[i] = (dx[i] - val * inv * b.dx[i]) * inv;
+		val *= inv;
+		return *this;
+	};
+	Dual& operator+=(const double b) { val += b; return *this; };
+	Dual& operator-=(const double b) { val -= b; return *this; };
+	Dual& operator*=(const double b)
+	{
+		val *= b;
+		for (int i = 0; i < N; i++)
+			dx[i] *= b;
+		return *this;
+	};
+	Dual& operator/=(const double b) { return *this *= 1.0 / b; };
+};
+
+template <int N> inline Dual<N> operator+(Dual<N> a, const Dual<N>& b) { return a += b; };
+template <int N> inline Dual<N> operator-(Dual<N> a, const Dual<N>& b) { return a -= b; };
+template <int N> inline Dual<N> operator*(Dual<N> a, const Dual<N>& b) { return a *= b; };
+template <int N> inline Dual<N> operator/(Dual<N> a, const Dual<N>& b) { return a /= b; };
+template <int N> inline Dual<N> operator+(Dual<N> a, const double b) { return a += b; };
+template <int N> inline Dual<N> operator-(Dual<N> a, const double b) { return a -= b; };
+template <int N> inline Dual<N> operator*(Dual<N> a, const double b) { return a *= b; };
+template <int N> inline Dual<N> operator/(Dual<N> a, const double b) { return a /= b; };
+template <int N> inline Dual<N> operator+(const double a, Dual<N> b) { return b += a; };
+template <int N> inline Dual<N> operator*(const double a, Dual<N> b) { return b *= a; };
+template <int N> inline Dual<N> operator-(const Dual<N>& a)
+{
+	Dual<N> res(-a.val);
+	for (int i = 0; i < N; i++)
+		res.dx[i] = -a.dx[i];
+	return res;
+};
+template <int N> inline Dual<N> operator-(const double a, const Dual<N>& b) { return -b + a; };
+template <int N> inline Dual<N> operator/(const double a, const Dual<N>& b) { return Dual<N>(a) /= b; };
+
+template <int N> inline bool operator>(const Dual<N>& a, const double b) { return a.val > b; };
+template <int N> inline bool operator<(const Dual<N>& a, const double b) { return a.val < b; };
+template <int N> inline bool operator>(const Dual<N>& a, const Dual<N>& b) { return a.val > b.val; };
+template <int N> inline bool operator<(const Dual<N>& a, const Dual<N>& b) { return a.val < b.val; };
+
+// Chain rule for the function with the value f and the derivative df at a.val
+template <int N> inline Dual<N> chain(const Dual<N>& a, const double f, const double df)
+{
+	Dual<N> res(f);
+	for (int i = 0; i < N; i++)
+		res.dx[i] = df * a.dx[i];
+	return res;
+};
+template <int N> inline Dual<N> exp(const Dual<N>& a)
+{
+	const double f = std::exp(a.val);
+	return chain(a, f, f);
+};
+template <int N> inline Dual<N> log(const Dual<N>& a)
+{
+	return chain(a, std::log(a.val), 1.0 / a.val);
+};
+template <int N> inline Dual<N> sqrt(const Dual<N>& a)
+{
+	const double f = std::sqrt(a.val);
+	return chain(a, f, 0.5 / f);
+};
+template <int N> inline Dual<N> pow(const Dual<N>& a, const double b)
+{
+	const double f = std::pow(a.val, b - 1.0);
+	return chain(a, f * a.val, b * f);
+};
+template <int N> inline Dual<N> fabs(const Dual<N>& a)
+{
+	return (a.val < 0.0) ? -a : a;
+};
+
+// Same semantics as ADOL-C condassign: res = a if cond > 0, otherwise b
+template <int N> inline void condassign(Dual<N>& res, const Dual<N>& cond, const Dual<N>& a, const Dual<N>& b)
+{
+	res = (cond.val > 0.0) ? a : b;
+};
+template <int N> inline void condassign(Dual<N>& res, const Dual<N>& cond, const Dual<N>& a)
+{
+	if (cond.val > 0.0)
+		res = a;
+};
+
+// Value of the scalar regardless of its type
+inline double getValue(const double a) { return a; };
+template <typename T> inline double getValue(const T& a) { return a.value(); };
+
+#endif /* DUAL_HPP_ */
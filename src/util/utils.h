@@ -45,6 +45,18 @@ inline void setDataFromFile(vector< pair<double,double> >& vec, string fileName)
 	file.close();
 };
 
+// 64-bit FNV-1a hash of the memory block, used as a key of disk caches
+inline unsigned long long hashBytes(const void* data, const size_t len, unsigned long long hash = 14695981039346656037ULL)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+};
+
 inline bool IsNan(double a)
 {
 	if (a!=a)  return true;